@@ -0,0 +1,273 @@
+// Machines packed densely for hosts that keep many. A MachinePool maps one contiguous arena
+// and cuts it into fixed-size slots, each holding a Machine and every buffer the machine
+// allocates when it is built (memory, code and watch flags, the keyboard queue), so that
+// acquire() and release() are a free-list pop or push with the constructor or destructor,
+// and no call to malloc. What a machine allocates later (hooks, devices, console output, a
+// keyboard queue grown past the slot) comes from the upstream resource. How the arena is
+// backed is a MemoryPolicy: by default it asks for transparent huge pages, as 4K pages cost
+// a TLB entry per 4K of guest memory.
+#pragma once
+
+#include "sveu16.h"
+
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+// Passes allocations on to upstream, counting them, for measuring what a machine allocates.
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    explicit CountingResource(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+        : upstream(upstream)
+    {
+    }
+
+    size_t allocations = 0; // calls so far
+    size_t bytes = 0;       // allocated and not deallocated yet
+    size_t peak = 0;        // most bytes at any time
+
+private:
+    std::pmr::memory_resource *upstream;
+
+    void *do_allocate(size_t size, size_t alignment) override
+    {
+        void *block = upstream->allocate(size, alignment);
+        allocations++;
+        bytes += size;
+        peak = std::max(peak, bytes);
+        return block;
+    }
+
+    void do_deallocate(void *block, size_t size, size_t alignment) override
+    {
+        upstream->deallocate(block, size, alignment);
+        bytes -= size;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+enum class PageSize : uint8_t
+{
+    SMALL,            // the system's pages as they come
+    TRANSPARENT_HUGE, // madvise(MADV_HUGEPAGE): huge pages where the kernel has them to give
+    HUGETLB           // MAP_HUGETLB: huge pages from the reserved pool (vm.nr_hugepages), or fail
+};
+
+struct MemoryPolicy
+{
+    PageSize pages = PageSize::TRANSPARENT_HUGE;
+    bool lock = false;     // mlock the arena, so it is never paged out
+    bool prefault = false; // fault every page in when mapping the arena, not on first touch
+
+    // "thp", "small" or "hugetlb", with "+mlock" and "+prefault" after it, as --memory takes.
+    bool parse(const std::string &text)
+    {
+        *this = MemoryPolicy();
+        size_t start = 0;
+        for (size_t i = 0; start <= text.size(); ++i)
+        {
+            size_t end = std::min(text.find('+', start), text.size());
+            std::string part = text.substr(start, end - start);
+            start = end + 1;
+            if (i == 0 && (part == "small" || part == "thp" || part == "hugetlb"))
+            {
+                pages = part == "small" ? PageSize::SMALL : part == "thp" ? PageSize::TRANSPARENT_HUGE : PageSize::HUGETLB;
+            }
+            else if (i > 0 && (part == "mlock" || part == "prefault"))
+            {
+                (part == "mlock" ? lock : prefault) = true;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+class MachinePool
+{
+public:
+    static constexpr size_t HUGE_PAGE_BYTES = 2 << 20;
+
+    size_t slot_bytes;       // arena bytes per machine: the Machine, its buffers and the slot's own
+    size_t capacity = 0;     // machines there is room for, 0 when the arena could not be mapped
+    bool huge_pages = false; // the arena has (or the kernel took MADV_HUGEPAGE for) huge pages
+    std::string error;       // why capacity is 0
+
+    explicit MachinePool(size_t machines, MemoryPolicy policy = MemoryPolicy(),
+                         std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+        : slot_bytes(measure_slot()), upstream(upstream)
+    {
+        mapped_bytes = machines * slot_bytes;
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        if (policy.pages == PageSize::HUGETLB)
+        {
+#ifdef MAP_HUGETLB
+            mapped_bytes = (mapped_bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+            flags |= MAP_HUGETLB;
+#else
+            error = "MAP_HUGETLB is not supported here";
+            return;
+#endif
+        }
+        void *mapped = machines == 0 ? MAP_FAILED : mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (mapped == MAP_FAILED)
+        {
+            error = machines == 0 ? "no machines" : std::string("mmap: ") + std::strerror(errno);
+            error += policy.pages == PageSize::HUGETLB ? " (are huge pages reserved in vm.nr_hugepages?)" : "";
+            return;
+        }
+        base = static_cast<char *>(mapped);
+        huge_pages = policy.pages == PageSize::HUGETLB;
+#ifdef MADV_HUGEPAGE
+        if (policy.pages == PageSize::TRANSPARENT_HUGE)
+        {
+            huge_pages = madvise(base, mapped_bytes, MADV_HUGEPAGE) == 0;
+        }
+#endif
+        if (policy.lock && mlock(base, mapped_bytes) != 0)
+        {
+            error = std::string("mlock: ") + std::strerror(errno) + " (see ulimit -l)";
+            munmap(base, mapped_bytes);
+            base = nullptr;
+            return;
+        }
+        // written, not read, so that every page is the arena's own rather than the zero page;
+        // after madvise, so that the faults bring in huge pages
+        for (size_t offset = 0; policy.prefault && offset < mapped_bytes; offset += 4096)
+        {
+            static_cast<volatile char *>(base)[offset] = 0;
+        }
+        capacity = machines;
+        slots.resize(capacity);
+        free_slots.reserve(capacity);
+        for (size_t i = capacity; i > 0; --i)
+        {
+            free_slots.push_back(i - 1);
+        }
+    }
+
+    // Destroys the machines not released.
+    ~MachinePool()
+    {
+        for (Machine *machine : slots)
+        {
+            if (machine)
+            {
+                release(machine);
+            }
+        }
+        if (base)
+        {
+            munmap(base, mapped_bytes);
+        }
+    }
+
+    MachinePool(const MachinePool &) = delete;
+    MachinePool &operator=(const MachinePool &) = delete;
+
+    // A new machine, as Machine() builds it, or nullptr when every slot is taken.
+    Machine *acquire()
+    {
+        if (free_slots.empty())
+        {
+            return nullptr;
+        }
+        size_t index = free_slots.back();
+        free_slots.pop_back();
+        Slot *free = new (base + index * slot_bytes) Slot(upstream, slot_bytes);
+        slots[index] = new (free->machine_storage()) Machine(free);
+        return slots[index];
+    }
+
+    void release(Machine *machine)
+    {
+        size_t index = (reinterpret_cast<char *>(machine) - base) / slot_bytes;
+        machine->~Machine();
+        reinterpret_cast<Slot *>(base + index * slot_bytes)->~Slot();
+        slots[index] = nullptr;
+        free_slots.push_back(index);
+    }
+
+    size_t in_use() const
+    {
+        return capacity - free_slots.size();
+    }
+
+private:
+    // The slot's memory resource: bump allocation from the rest of the slot, then upstream.
+    // Blocks in the slot are given back all at once when the machine is released.
+    struct Slot : std::pmr::memory_resource
+    {
+        Slot(std::pmr::memory_resource *upstream, size_t bytes)
+            : upstream(upstream), next(machine_storage() + sizeof(Machine)), end(reinterpret_cast<char *>(this) + bytes)
+        {
+        }
+
+        std::pmr::memory_resource *upstream;
+        char *next;
+        char *end;
+
+        char *machine_storage()
+        {
+            return reinterpret_cast<char *>(this) + (sizeof(Slot) + alignof(Machine) - 1) / alignof(Machine) * alignof(Machine);
+        }
+
+        void *do_allocate(size_t size, size_t alignment) override
+        {
+            char *block = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(next) + alignment - 1) & ~(alignment - 1));
+            if (block + size > end)
+            {
+                return upstream->allocate(size, alignment);
+            }
+            next = block + size;
+            return block;
+        }
+
+        void do_deallocate(void *block, size_t size, size_t alignment) override
+        {
+            if (block < static_cast<void *>(this) || block >= static_cast<void *>(end))
+            {
+                upstream->deallocate(block, size, alignment);
+            }
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+
+    std::pmr::memory_resource *upstream;
+    char *base = nullptr;
+    size_t mapped_bytes = 0;
+    std::vector<Machine *> slots;   // the machine in every slot, nullptr when free
+    std::vector<size_t> free_slots; // reserved for every slot, so pushing never allocates
+
+    // What a new machine allocates, with room to align every block, rounded up to a cache
+    // line so that no two machines share one.
+    static size_t measure_slot()
+    {
+        CountingResource counting;
+        {
+            Machine measured(&counting);
+        }
+        size_t bytes = sizeof(Slot) + alignof(Machine) + sizeof(Machine) + counting.peak +
+                       counting.allocations * alignof(std::max_align_t);
+        return (bytes + 63) / 64 * 64;
+    }
+};
@@ -0,0 +1,607 @@
+// Two-pass assembler for the source format of forth.asm:
+//   [LABEL[:]] MNE Rd,Ra,Rb      one instruction word, MNE one of the 16 opcodes in sveu16.h
+//   [LABEL[:]] WRD value         one word: $hex, decimal (may be negative) or a label
+//   [LABEL[:]] TXT "text"        one word per character, no count
+//   LABEL      CON value         defines LABEL as value, emits nothing
+//              ORG value         continues at address value
+// A label may also stand on a line of its own. ';' starts a comment and anything after the
+// operands is ignored. Lines are parsed into statements first; then every label is given its
+// address, then the words are emitted.
+#pragma once
+
+#include "sveu16.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct AssemblySymbol
+{
+    std::string name;
+    uint16_t value;
+    bool constant; // defined by CON rather than by its position
+};
+
+struct Assembly
+{
+    std::vector<uint16_t> image;         // address 0 up to the last word emitted
+    std::vector<AssemblySymbol> symbols; // in source order
+};
+
+namespace assembler_detail
+{
+const char *const MNEMONICS[16] = {"LOD", "ADD", "SUB", "AND", "ORA", "XOR", "SHR", "MUL",
+                                   "STO", "MIF", "GTU", "GTS", "LTU", "LTS", "EQU", "MAJ"};
+
+enum Directive : uint8_t
+{
+    INSTRUCTION, WRD, TXT, CON, ORG, NONE
+};
+
+constexpr int32_t NO_SYMBOL = -1;
+constexpr uint32_t MAX_SECTION_LINES = 64;
+
+// A parsed statement. Symbols are indexes into the assembler's name table, so a statement
+// does not change when the source around it does.
+struct Statement
+{
+    uint32_t line;     // within its section, from 0
+    Directive directive;
+    uint16_t word;     // the instruction, or the operand when it is a number
+    int32_t operand;   // the symbol the operand names, NO_SYMBOL for a number
+    int32_t label;     // the symbol the statement defines, NO_SYMBOL for none
+    std::string text;  // TXT only
+};
+
+// The statements of a run of source lines. A section ends before a comment or label in the
+// first column that follows code, or after MAX_SECTION_LINES lines: in forth.asm every word
+// and every character of the font is a section of its own.
+struct Section
+{
+    uint64_t hash;
+    uint32_t length; // bytes of source
+    uint32_t lines;
+    std::vector<Statement> statements;
+};
+
+inline uint64_t hash_text(const char *text, size_t length)
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, text + i, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    for (; i < length; ++i)
+    {
+        hash = (hash ^ static_cast<uint8_t>(text[i])) * 0x100000001B3ull;
+    }
+    return hash ^ (hash >> 29);
+}
+
+inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline std::string next_token(const std::string &line, size_t &pos)
+{
+    while (pos < line.size() && is_space(line[pos]))
+    {
+        ++pos;
+    }
+    size_t start = pos;
+    while (pos < line.size() && !is_space(line[pos]) && line[pos] != ';')
+    {
+        ++pos;
+    }
+    return line.substr(start, pos - start);
+}
+
+inline Directive directive_of(const std::string &token, uint16_t &opcode)
+{
+    for (uint16_t i = 0; i < 16; ++i)
+    {
+        if (token == MNEMONICS[i])
+        {
+            opcode = i;
+            return INSTRUCTION;
+        }
+    }
+    if (token == "WRD")
+    {
+        return WRD;
+    }
+    if (token == "TXT")
+    {
+        return TXT;
+    }
+    if (token == "CON")
+    {
+        return CON;
+    }
+    return token == "ORG" ? ORG : NONE;
+}
+
+inline bool parse_number(const std::string &text, long &value)
+{
+    size_t start = text[0] == '-' ? 1 : 0;
+    int base = 10;
+    if (start < text.size() && text[start] == '$')
+    {
+        base = 16;
+        ++start;
+    }
+    if (start == text.size())
+    {
+        return false;
+    }
+    value = 0;
+    for (size_t i = start; i < text.size(); ++i)
+    {
+        int digit = text[i] >= '0' && text[i] <= '9'   ? text[i] - '0'
+                    : text[i] >= 'A' && text[i] <= 'F' ? text[i] - 'A' + 10
+                    : text[i] >= 'a' && text[i] <= 'f' ? text[i] - 'a' + 10
+                                                       : 99;
+        if (digit >= base || value > 0xFFFF)
+        {
+            return false;
+        }
+        value = value * base + digit;
+    }
+    value = text[0] == '-' ? -value : value;
+    return value >= -0x8000 && value <= 0xFFFF;
+}
+
+inline bool parse_register(const std::string &text, size_t &pos, uint16_t &reg)
+{
+    if (pos >= text.size() || text[pos] != 'R')
+    {
+        return false;
+    }
+    size_t start = ++pos;
+    unsigned value = 0;
+    while (pos < text.size() && pos - start < 2 && text[pos] >= '0' && text[pos] <= '9')
+    {
+        value = value * 10 + (text[pos++] - '0');
+    }
+    reg = static_cast<uint16_t>(value);
+    return pos > start && value < 16;
+}
+
+inline std::string error_at(uint32_t line, const std::string &message)
+{
+    return "line " + std::to_string(line) + ": " + message;
+}
+} // namespace assembler_detail
+
+// Assembles a source over and over as it is edited. Sections whose text has not changed
+// since the last assemble (or since the cache was read) are not parsed again. Laying out and
+// resolving the statements of the whole source again is cheap next to parsing it.
+class Assembler
+{
+public:
+    // Assembles source into assembly. Returns false and sets error ("line N: ...") on the
+    // first statement it cannot assemble.
+    bool assemble(const std::string &source, Assembly &assembly, std::string &error)
+    {
+        using namespace assembler_detail;
+        std::unordered_map<uint64_t, size_t> cached;
+        for (size_t i = 0; i < sections.size(); ++i)
+        {
+            cached.emplace(sections[i].hash, i);
+        }
+        std::vector<uint8_t> reused(sections.size(), 0);
+        std::vector<Section> next;
+        std::vector<uint32_t> first_lines;
+        parsed = 0;
+
+        uint32_t line = 1;
+        for (size_t begin = 0; begin < source.size();)
+        {
+            size_t end = section_end(source, begin);
+            uint32_t length = static_cast<uint32_t>(end - begin);
+            uint64_t hash = hash_text(source.data() + begin, length);
+            auto it = cached.find(hash);
+            if (it != cached.end() && !reused[it->second] && sections[it->second].length == length)
+            {
+                reused[it->second] = 1;
+                next.push_back(std::move(sections[it->second]));
+            }
+            else
+            {
+                next.emplace_back();
+                if (!parse(source, begin, end, line, next.back(), error))
+                {
+                    next.pop_back();
+                    sections = std::move(next); // the sections not reused yet have been moved from
+                    return false;
+                }
+                next.back().hash = hash;
+                ++parsed;
+            }
+            first_lines.push_back(line);
+            line += next.back().lines;
+            begin = end;
+        }
+        sections = std::move(next);
+        return resolve(first_lines, assembly, error);
+    }
+
+    // Sections parsed by the last assemble, the rest came from the cache.
+    size_t parsed_sections() const
+    {
+        return parsed;
+    }
+
+    void write_cache(std::ostream &out) const
+    {
+        auto put = [&](uint64_t value, int bytes) {
+            for (int i = 0; i < bytes; ++i)
+            {
+                out.put(static_cast<char>(value >> (8 * i)));
+            }
+        };
+        auto put_string = [&](const std::string &text) {
+            put(text.size(), 4);
+            out.write(text.data(), text.size());
+        };
+        out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        put(names.size(), 4);
+        for (const std::string &name : names)
+        {
+            put_string(name);
+        }
+        put(sections.size(), 4);
+        for (const assembler_detail::Section &section : sections)
+        {
+            put(section.hash, 8);
+            put(section.length, 4);
+            put(section.lines, 4);
+            put(section.statements.size(), 4);
+            for (const assembler_detail::Statement &statement : section.statements)
+            {
+                put(statement.line, 4);
+                put(statement.directive, 1);
+                put(statement.word, 2);
+                put(static_cast<uint32_t>(statement.operand), 4);
+                put(static_cast<uint32_t>(statement.label), 4);
+                put_string(statement.text);
+            }
+        }
+    }
+
+    // Replaces the cached sections with those in the stream. Returns false, leaving the
+    // assembler empty, when it is not a cache this version wrote.
+    bool read_cache(std::istream &in)
+    {
+        using namespace assembler_detail;
+        *this = Assembler();
+        std::stringstream contents;
+        contents << in.rdbuf();
+        std::string buffer = contents.str();
+        size_t pos = 0;
+        bool ok = true;
+        auto get = [&](int bytes) {
+            uint64_t value = 0;
+            ok = ok && pos + bytes <= buffer.size();
+            for (int i = 0; ok && i < bytes; ++i)
+            {
+                value |= static_cast<uint64_t>(static_cast<uint8_t>(buffer[pos++])) << (8 * i);
+            }
+            return value;
+        };
+        auto get_string = [&]() {
+            size_t length = static_cast<size_t>(get(4));
+            ok = ok && pos + length <= buffer.size();
+            std::string text = ok ? buffer.substr(pos, length) : std::string();
+            pos += text.size();
+            return text;
+        };
+        ok = buffer.compare(0, sizeof(CACHE_MAGIC), CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0;
+        pos = sizeof(CACHE_MAGIC);
+        for (uint32_t i = 0, count = static_cast<uint32_t>(get(4)); ok && i < count; ++i)
+        {
+            names.push_back(get_string());
+            ok = ok && ids.emplace(names.back(), static_cast<int32_t>(i)).second;
+        }
+        for (uint32_t i = 0, count = static_cast<uint32_t>(get(4)); ok && i < count; ++i)
+        {
+            Section section;
+            section.hash = get(8);
+            section.length = static_cast<uint32_t>(get(4));
+            section.lines = static_cast<uint32_t>(get(4));
+            for (uint32_t j = 0, statements = static_cast<uint32_t>(get(4)); ok && j < statements; ++j)
+            {
+                Statement statement;
+                statement.line = static_cast<uint32_t>(get(4));
+                statement.directive = static_cast<Directive>(get(1));
+                statement.word = static_cast<uint16_t>(get(2));
+                statement.operand = static_cast<int32_t>(get(4));
+                statement.label = static_cast<int32_t>(get(4));
+                statement.text = get_string();
+                ok = ok && statement.directive < NONE + 1 && statement.operand < static_cast<int32_t>(names.size()) &&
+                     statement.label < static_cast<int32_t>(names.size()) && statement.operand >= NO_SYMBOL &&
+                     statement.label >= NO_SYMBOL;
+                section.statements.push_back(std::move(statement));
+            }
+            sections.push_back(std::move(section));
+        }
+        if (!ok)
+        {
+            *this = Assembler();
+        }
+        return ok;
+    }
+
+private:
+    static constexpr char CACHE_MAGIC[8] = {'S', 'V', 'A', 'S', 'M', 'C', '0', '1'};
+
+    std::vector<std::string> names; // every symbol name any section has used
+    std::unordered_map<std::string, int32_t> ids;
+    std::vector<assembler_detail::Section> sections;
+    size_t parsed = 0;
+
+    int32_t symbol(const std::string &name)
+    {
+        auto it = ids.emplace(name, static_cast<int32_t>(names.size())).first;
+        if (it->second == static_cast<int32_t>(names.size()))
+        {
+            names.push_back(name);
+        }
+        return it->second;
+    }
+
+    static size_t section_end(const std::string &source, size_t begin)
+    {
+        const char *text = source.data();
+        const char *end = text + source.size();
+        bool code = false; // a line of the section has a statement
+        uint32_t lines = 0;
+        for (const char *line = text + begin; line < end; ++lines)
+        {
+            if ((code && *line != ' ' && *line != '\t' && *line != '\r' && *line != '\n') ||
+                lines == assembler_detail::MAX_SECTION_LINES)
+            {
+                return line - text;
+            }
+            const char *first = line;
+            while (first < end && (*first == ' ' || *first == '\t' || *first == '\r'))
+            {
+                ++first;
+            }
+            code = code || (first < end && *first != ';' && *first != '\n');
+            const char *newline = static_cast<const char *>(std::memchr(first, '\n', end - first));
+            line = newline ? newline + 1 : end;
+        }
+        return source.size();
+    }
+
+    bool parse(const std::string &source, size_t begin, size_t end, uint32_t first_line,
+               assembler_detail::Section &section, std::string &error)
+    {
+        using namespace assembler_detail;
+        section.length = static_cast<uint32_t>(end - begin);
+        section.lines = 0;
+        for (size_t pos = begin; pos < end; ++section.lines)
+        {
+            size_t stop = source.find('\n', pos);
+            stop = stop == std::string::npos || stop > end ? end : stop;
+            std::string line = source.substr(pos, stop - pos);
+            pos = stop + 1;
+
+            size_t at = 0;
+            std::string token = next_token(line, at);
+            if (token.empty())
+            {
+                continue;
+            }
+            uint32_t number = first_line + section.lines;
+            Statement statement{section.lines, NONE, 0, NO_SYMBOL, NO_SYMBOL, ""};
+            uint16_t opcode = 0;
+            statement.directive = directive_of(token, opcode);
+            if (statement.directive == NONE)
+            {
+                statement.label = symbol(token.back() == ':' ? token.substr(0, token.size() - 1) : token);
+                token = next_token(line, at);
+                statement.directive = directive_of(token, opcode);
+                if (statement.directive == NONE && !token.empty())
+                {
+                    error = error_at(number, "unknown mnemonic " + token);
+                    return false;
+                }
+            }
+
+            if (statement.directive == TXT)
+            {
+                size_t open = line.find('"', at);
+                size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+                if (close == std::string::npos)
+                {
+                    error = error_at(number, "TXT needs a quoted string");
+                    return false;
+                }
+                statement.text = line.substr(open + 1, close - open - 1);
+            }
+            else if (statement.directive == INSTRUCTION)
+            {
+                std::string operand = next_token(line, at);
+                uint16_t d, a, b;
+                size_t i = 0;
+                if (!parse_register(operand, i, d) || operand[i++] != ',' || !parse_register(operand, i, a) ||
+                    operand[i++] != ',' || !parse_register(operand, i, b))
+                {
+                    error = error_at(number, "expected Rd,Ra,Rb, not " + operand);
+                    return false;
+                }
+                statement.word = opcode << 12 | d << 8 | a << 4 | b;
+            }
+            else if (statement.directive != NONE)
+            {
+                std::string operand = next_token(line, at);
+                long value;
+                if (operand.empty())
+                {
+                    error = error_at(number, "missing operand");
+                    return false;
+                }
+                if (parse_number(operand, value))
+                {
+                    statement.word = static_cast<uint16_t>(value);
+                }
+                else
+                {
+                    statement.operand = symbol(operand);
+                }
+            }
+            if (statement.directive == CON && statement.label == NO_SYMBOL)
+            {
+                error = error_at(number, "CON needs a label");
+                return false;
+            }
+            section.statements.push_back(std::move(statement));
+        }
+        return true;
+    }
+
+    // Gives every label its address, then emits the words.
+    bool resolve(const std::vector<uint32_t> &first_lines, Assembly &assembly, std::string &error) const
+    {
+        using namespace assembler_detail;
+        struct Placed
+        {
+            const Statement *statement;
+            uint32_t address;
+            uint32_t line;
+        };
+        std::vector<Placed> placed;
+        std::vector<uint16_t> values(names.size());
+        std::vector<uint8_t> defined(names.size(), 0);
+        assembly = Assembly();
+
+        auto value_of = [&](const Statement &statement, uint32_t line, uint16_t &value) {
+            if (statement.operand == NO_SYMBOL)
+            {
+                value = statement.word;
+                return true;
+            }
+            if (!defined[statement.operand])
+            {
+                error = error_at(line, "undefined symbol " + names[statement.operand]);
+                return false;
+            }
+            value = values[statement.operand];
+            return true;
+        };
+
+        uint32_t address = 0;
+        uint32_t end = 0;
+        for (size_t i = 0; i < sections.size(); ++i)
+        {
+            for (const Statement &statement : sections[i].statements)
+            {
+                uint32_t line = first_lines[i] + statement.line;
+                if (statement.label != NO_SYMBOL)
+                {
+                    uint16_t value = static_cast<uint16_t>(address);
+                    if (statement.directive == CON && !value_of(statement, line, value))
+                    {
+                        return false;
+                    }
+                    if (defined[statement.label])
+                    {
+                        error = error_at(line, "duplicate label " + names[statement.label]);
+                        return false;
+                    }
+                    defined[statement.label] = 1;
+                    values[statement.label] = value;
+                    assembly.symbols.push_back({names[statement.label], value, statement.directive == CON});
+                }
+
+                if (statement.directive == ORG)
+                {
+                    uint16_t origin;
+                    if (!value_of(statement, line, origin))
+                    {
+                        return false;
+                    }
+                    address = origin;
+                }
+                else if (statement.directive != CON && statement.directive != NONE)
+                {
+                    placed.push_back({&statement, address, line});
+                    address += statement.directive == TXT ? statement.text.size() : 1;
+                    if (address > 0x10000)
+                    {
+                        error = error_at(line, "past the end of memory");
+                        return false;
+                    }
+                    end = std::max(end, address);
+                }
+            }
+        }
+
+        assembly.image.resize(end, 0);
+        for (const Placed &place : placed)
+        {
+            const Statement &statement = *place.statement;
+            uint16_t *out = &assembly.image[place.address];
+            if (statement.directive == TXT)
+            {
+                for (char c : statement.text)
+                {
+                    *out++ = static_cast<uint8_t>(c);
+                }
+            }
+            else if (!value_of(statement, place.line, *out))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Assembles source into assembly from scratch.
+inline bool assemble(const std::string &source, Assembly &assembly, std::string &error)
+{
+    Assembler assembler;
+    return assembler.assemble(source, assembly, error);
+}
+
+// The symbol table as table.txt has it: "NAME hex " per line, labels from the last one
+// defined back to the first, then the constants the same way.
+inline std::string symbol_table(const Assembly &assembly)
+{
+    std::string table;
+    char value[8];
+    for (bool constants : {false, true})
+    {
+        for (auto it = assembly.symbols.rbegin(); it != assembly.symbols.rend(); ++it)
+        {
+            if (it->constant == constants)
+            {
+                std::snprintf(value, sizeof(value), "%4x", it->value);
+                table += it->name + " " + value + " \n";
+            }
+        }
+    }
+    return table;
+}
+
+// Writes a raw image (see image.h), as Machine::load_memory reads it.
+inline bool save_image(const std::string &filename, const std::vector<uint16_t> &image)
+{
+    std::ofstream file(filename, std::ios::binary);
+    file << raw_image(image.data(), image.size());
+    return static_cast<bool>(file);
+}
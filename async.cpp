@@ -0,0 +1,137 @@
+#include "async.h"
+#include "sveu16.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sveu16
+{
+namespace
+{
+// How often a slice checks for input waits and stops, as run_until_idle does.
+constexpr uint64_t CHUNK = 10000;
+} // namespace
+
+struct Scheduler::Impl
+{
+    uint64_t slice;
+    std::mutex mutex;
+    std::condition_variable ready;   // a run was queued, or the threads are to stop
+    std::condition_variable settled; // nothing queued or running
+    std::deque<Run *> queue;
+    size_t running = 0;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    // Runs one slice of run. Returns true when it has ended, with its event set.
+    bool turn(Run &run)
+    {
+        Machine &machine = run.vm.machine();
+        uint64_t end = std::min(run.end, machine.cycles + std::min(slice, UINT64_MAX - machine.cycles));
+        while (true)
+        {
+            if (machine.stop.reason != StopReason::NONE)
+            {
+                run.event = Event::HALT;
+                return true;
+            }
+            if (waiting_for_input(machine))
+            {
+                run.event = Event::INPUT;
+                return true;
+            }
+            if (machine.cycles >= run.end)
+            {
+                run.event = Event::BUDGET;
+                return true;
+            }
+            if (machine.cycles >= end)
+            {
+                return false;
+            }
+            machine.run(std::min(CHUNK, end - machine.cycles));
+        }
+    }
+
+    // Runs are taken in turn, a slice each; an ended one resumes its coroutine here, which may
+    // free the Run with its frame before the next one is submitted.
+    void work()
+    {
+        while (true)
+        {
+            Run *run;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                {
+                    return;
+                }
+                run = queue.front();
+                queue.pop_front();
+                running++;
+            }
+
+            bool ended = turn(*run);
+            if (ended)
+            {
+                run->handle.resume();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ended)
+            {
+                queue.push_back(run);
+                ready.notify_one();
+            }
+            if (--running == 0 && queue.empty())
+            {
+                settled.notify_all();
+            }
+        }
+    }
+};
+
+Scheduler::Scheduler(unsigned threads, uint64_t slice) : impl(new Impl)
+{
+    impl->slice = std::max<uint64_t>(slice, 1);
+    threads = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        impl->threads.emplace_back([this] { impl->work(); });
+    }
+}
+
+Scheduler::~Scheduler()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->stopping = true;
+    }
+    impl->ready.notify_all();
+    for (std::thread &thread : impl->threads)
+    {
+        thread.join();
+    }
+}
+
+void Scheduler::wait()
+{
+    std::unique_lock<std::mutex> lock(impl->mutex);
+    impl->settled.wait(lock, [this] { return impl->queue.empty() && impl->running == 0; });
+}
+
+void Scheduler::submit(Run &run)
+{
+    uint64_t cycles = run.vm.cycles();
+    run.end = cycles + std::min(run.budget, UINT64_MAX - cycles);
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->queue.push_back(&run);
+    impl->ready.notify_one();
+}
+} // namespace sveu16
@@ -0,0 +1,82 @@
+// Vms run from an event loop with C++20 coroutines. A coroutine awaits scheduler.run(vm) and
+// is resumed, on one of the scheduler's threads, with the Event that ended the run: the guest
+// waits for input, has run the budget, or stopped at a breakpoint or watchpoint. The Vm
+// belongs to the scheduler from the co_await until the coroutine resumes; the host touches it
+// (type, peek, call) only in between. Runs are interleaved slice by slice over the threads,
+// and a Vm nobody awaits is not run at all, so idle ones cost nothing however many there are.
+#pragma once
+
+#include "libsveu16.h"
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <memory>
+
+namespace sveu16
+{
+enum class Event : uint8_t
+{
+    INPUT,  // eForth waits for a key (?RX keeps finding none); type and run again
+    BUDGET, // the budget ran out first
+    HALT    // Machine::stop is set; clear it to run again
+};
+
+// A coroutine that starts at once and frees itself when it ends, for sessions awaiting runs.
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+class SVEU16_API Scheduler
+{
+public:
+    class Run
+    {
+    public:
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> awaiting)
+        {
+            handle = awaiting;
+            scheduler.submit(*this);
+        }
+        Event await_resume() const noexcept { return event; }
+
+    private:
+        friend class Scheduler;
+        Run(Scheduler &scheduler, Vm &vm, uint64_t budget) : scheduler(scheduler), vm(vm), budget(budget) {}
+
+        Scheduler &scheduler;
+        Vm &vm;
+        uint64_t budget;
+        uint64_t end = 0; // in machine cycles, set when submitted
+        Event event = Event::BUDGET;
+        std::coroutine_handle<> handle;
+    };
+
+    // threads 0 is one per hardware thread. Each turn runs a Vm for up to slice cycles.
+    explicit Scheduler(unsigned threads = 0, uint64_t slice = 200000);
+    // Waits for the runs in progress (their coroutines are resumed) and stops the threads.
+    ~Scheduler();
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    // co_await: runs vm for up to budget cycles, until an Event.
+    Run run(Vm &vm, uint64_t budget = UINT64_MAX) { return Run(*this, vm, budget); }
+    // Blocks until no run is waiting or in progress, resumed coroutines' new runs included.
+    void wait();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+
+    void submit(Run &run);
+};
+} // namespace sveu16
@@ -0,0 +1,314 @@
+// Benchmarks. The suite: Forth workloads typed at the eForth prompt of a booted image. A workload
+// defines what it needs first, untimed, then runs; the run is timed repeat times, each from
+// a copy of the machine as the definitions left it, and checked by the number it leaves in
+// the variable RESULT, which the suite defines first. Guest
+// instructions take one cycle each (native hooks count those they stand for), so MIPS is
+// cycles per host microsecond. Forth words are counted in one more, untimed, run with hooks
+// on NEXT1 and LIST1 (which dispatches the first word of a colon body inline).
+// Microbenchmarks: host side hot paths timed on their own, each run for as many iterations
+// as take min_time, then that many again per repetition.
+#pragma once
+
+#include "dictionary.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct Workload
+{
+    std::string name;
+    std::string setup;  // typed and run before timing
+    std::string run;    // typed and timed, storing to RESULT
+    uint16_t expect;    // what RESULT must hold then
+};
+
+struct BenchResult
+{
+    std::string name;
+    uint64_t cycles = 0;
+    uint64_t words = 0;            // Forth words dispatched
+    std::vector<double> seconds;   // wall time of every repetition
+};
+
+namespace bench_detail
+{
+// run_until_idle in smaller chunks, so that less of the wait is timed.
+inline bool settle(Machine &machine)
+{
+    return run_until_idle(machine, 2000000000, 1000);
+}
+
+inline void type_lines(Machine &machine, const std::string &text)
+{
+    for (char c : text)
+    {
+        machine.keyboard.push_back(c == '\n' ? '\r' : static_cast<uint8_t>(c));
+    }
+}
+
+inline std::string quoted(const std::string &text)
+{
+    std::string out = "\"";
+    for (char c : text)
+    {
+        out += c == '"' || c == '\\' ? std::string("\\") + c : std::string(1, c);
+    }
+    return out + "\"";
+}
+
+// 97.5th percentile of Student's t for 1 to 30 degrees of freedom, then the normal's.
+inline double t_975(size_t freedom)
+{
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    return freedom == 0 ? 0 : freedom <= 30 ? table[freedom - 1] : 1.960;
+}
+
+// {"mean": m, "ci95": h}: the mean and the half width of its 95% confidence interval.
+inline std::string interval(const std::vector<double> &values)
+{
+    double mean = 0;
+    for (double value : values)
+    {
+        mean += value / values.size();
+    }
+    double squares = 0;
+    for (double value : values)
+    {
+        squares += (value - mean) * (value - mean);
+    }
+    double half = values.size() > 1 ? t_975(values.size() - 1) * std::sqrt(squares / (values.size() - 1) / values.size()) : 0;
+    char text[96];
+    std::snprintf(text, sizeof(text), "{\"mean\": %.6g, \"ci95\": %.6g}", mean, half);
+    return text;
+}
+} // namespace bench_detail
+
+// The standard suite: the sieve of Eratosthenes, recursive Fibonacci, MOVE between buffers,
+// printing numbers with ., compiling a long source (every definition looked up by the next),
+// and drawing whole lines of characters.
+inline std::vector<Workload> bench_workloads()
+{
+    std::string chain = ": W0 0 ;\n";
+    for (int i = 1; i < 200; ++i)
+    {
+        chain += ": W" + std::to_string(i) + " W" + std::to_string(i - 1) + " 1 + ;\n";
+    }
+    return {
+        {"sieve",
+         "DECIMAL CREATE FLAGS 4000 ALLOT\n"
+         ": PRIME? ( i -- f ) FLAGS + @ ;\n"
+         ": STRIKE ( i -- ) DUP DUP + 3 + SWAP OVER + BEGIN DUP 4000 < WHILE\n"
+         "  0 OVER FLAGS + ! OVER + REPEAT 2DROP ;\n"
+         ": SIEVE ( -- n ) FLAGS 4000 1 FILL 0 0 BEGIN DUP 4000 < WHILE\n"
+         "  DUP PRIME? IF DUP STRIKE SWAP 1 + SWAP THEN 1 + REPEAT DROP ;\n",
+         "SIEVE DROP SIEVE DROP SIEVE RESULT !\n", 1006},
+        {"fib", "DECIMAL : FIB ( n -- f ) DUP 2 < 0= IF DUP 1 - RECURSE SWAP 2 - RECURSE + THEN ;\n", "22 FIB RESULT !\n",
+         17711},
+        {"move",
+         "DECIMAL CREATE A 1000 ALLOT CREATE B 1000 ALLOT A 1000 7 FILL\n"
+         ": MOVES 0 BEGIN DUP 1000 < WHILE A B 1000 MOVE B A 1000 MOVE 1 + REPEAT DROP ;\n",
+         "MOVES B 999 + @ RESULT !\n", 7},
+        {"numbers", "DECIMAL : NUMBERS 0 BEGIN DUP 300 < WHILE DUP 97 * . 1 + REPEAT ;\n",
+         "NUMBERS RESULT !\n", 300},
+        {"compile", "DECIMAL\n", chain + "W199 RESULT !\n", 199},
+        {"drawchar",
+         "DECIMAL : ROW 0 BEGIN DUP 78 < WHILE DUP 33 + EMIT 1 + REPEAT DROP CR ;\n"
+         ": ROWS 0 BEGIN DUP 120 < WHILE ROW 1 + REPEAT ;\n",
+         "ROWS RESULT !\n", 120},
+    };
+}
+
+// Runs every workload on copies of booted, a machine at the eForth prompt. Returns false,
+// with the workload and what went wrong in error, when one does not finish or leaves another
+// result than it should.
+inline bool run_bench(const Machine &booted, const std::vector<Workload> &workloads, size_t repeat,
+                      std::vector<BenchResult> &results, std::string &error)
+{
+    using namespace bench_detail;
+    Machine prepared = booted;
+    type_lines(prepared, "VARIABLE RESULT\n");
+    settle(prepared);
+    uint16_t result_na = find_name(prepared, "RESULT");
+    if (result_na == 0)
+    {
+        error = "RESULT could not be defined";
+        return false;
+    }
+    uint16_t result_cell = name_to_cfa(prepared.memory, result_na) + 2; // after the code field and _VAR
+    uint16_t list1 = colon_code(prepared.memory, find_headers(prepared.memory, VIDEO_MEMORY_START));
+    results.clear();
+    for (const Workload &workload : workloads)
+    {
+        Machine ready = prepared;
+        type_lines(ready, workload.setup);
+        if (!settle(ready))
+        {
+            error = workload.name + ": the definitions did not finish";
+            return false;
+        }
+        BenchResult result;
+        result.name = workload.name;
+        for (size_t i = 0; i < repeat; ++i)
+        {
+            Machine machine = ready;
+            type_lines(machine, workload.run);
+            auto begin = std::chrono::steady_clock::now();
+            bool finished = settle(machine);
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+            result.seconds.push_back(seconds.count());
+            result.cycles = machine.cycles - ready.cycles;
+            if (!finished || machine.memory[result_cell] != workload.expect)
+            {
+                error = workload.name + (finished ? ": left " + std::to_string(machine.memory[result_cell]) +
+                                                        " instead of " + std::to_string(workload.expect)
+                                                  : ": did not finish");
+                return false;
+            }
+        }
+
+        Machine counted = ready;
+        if (list1 >= 3)
+        {
+            uint64_t &words = result.words;
+            NativeHook next = counted.hook(list1 - 3);
+            counted.install_hook(list1 - 3, [&words, next](Machine &m) {
+                ++words;
+                return next && next(m);
+            });
+            NativeHook list = counted.hook(list1);
+            counted.install_hook(list1, [&words, list](Machine &m) {
+                if (list && list(m))
+                {
+                    return true;
+                }
+                ++words;
+                return false;
+            });
+        }
+        type_lines(counted, workload.run);
+        settle(counted);
+        results.push_back(result);
+    }
+    return true;
+}
+
+// The results as JSON: per workload and for the whole suite, cycles, Forth words and cycles
+// per word, and the wall time and MIPS of the repetitions as means with 95% intervals.
+inline std::string bench_json(const std::string &image, size_t repeat, const std::vector<BenchResult> &results)
+{
+    using namespace bench_detail;
+    auto record = [](const std::string &name, uint64_t cycles, uint64_t words, const std::vector<double> &seconds) {
+        std::vector<double> mips;
+        for (double second : seconds)
+        {
+            mips.push_back(cycles / std::max(second, 1e-9) / 1e6);
+        }
+        char numbers[160];
+        std::snprintf(numbers, sizeof(numbers), "\"cycles\": %llu, \"words\": %llu, \"cycles_per_word\": %.4f, ",
+                      static_cast<unsigned long long>(cycles), static_cast<unsigned long long>(words),
+                      words ? static_cast<double>(cycles) / words : 0.0);
+        return "{\"name\": " + quoted(name) + ", " + numbers + "\"wall_seconds\": " + interval(seconds) +
+               ", \"mips\": " + interval(mips) + "}";
+    };
+    std::string text = "{\n  \"image\": " + quoted(image) + ",\n  \"repeat\": " + std::to_string(repeat) +
+                       ",\n  \"workloads\": [\n";
+    uint64_t cycles = 0;
+    uint64_t words = 0;
+    std::vector<double> seconds(repeat, 0.0);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult &result = results[i];
+        text += "    " + record(result.name, result.cycles, result.words, result.seconds) +
+                (i + 1 < results.size() ? ",\n" : "\n");
+        cycles += result.cycles;
+        words += result.words;
+        for (size_t j = 0; j < repeat && j < result.seconds.size(); ++j)
+        {
+            seconds[j] += result.seconds[j];
+        }
+    }
+    return text + "  ],\n  \"total\": " + record("total", cycles, words, seconds) + "\n}\n";
+}
+
+// run(n) does n iterations of a hot path and returns the items they went through
+// (instructions, frames, events), which the rate is given in.
+struct Microbenchmark
+{
+    std::string name;
+    std::function<uint64_t(uint64_t iterations)> run;
+};
+
+struct MicrobenchResult
+{
+    std::string name;
+    uint64_t iterations = 0; // per repetition
+    uint64_t items = 0;      // per repetition
+    std::vector<double> seconds;
+};
+
+// Runs the microbenchmarks whose name contains filter.
+inline std::vector<MicrobenchResult> run_microbenchmarks(const std::vector<Microbenchmark> &benchmarks,
+                                                         const std::string &filter, double min_time, size_t repeat)
+{
+    auto time = [](const Microbenchmark &benchmark, uint64_t iterations, uint64_t &items) {
+        auto begin = std::chrono::steady_clock::now();
+        items = benchmark.run(iterations);
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+        return seconds.count();
+    };
+    std::vector<MicrobenchResult> results;
+    for (const Microbenchmark &benchmark : benchmarks)
+    {
+        if (benchmark.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        MicrobenchResult result;
+        result.name = benchmark.name;
+        result.iterations = 1;
+        for (double seconds = time(benchmark, 1, result.items); seconds < min_time;
+             seconds = time(benchmark, result.iterations, result.items))
+        {
+            double factor = std::min(std::max(1.4 * min_time / std::max(seconds, 1e-9), 2.0), 100.0);
+            result.iterations = static_cast<uint64_t>(result.iterations * factor);
+        }
+        for (size_t i = 0; i < repeat; ++i)
+        {
+            result.seconds.push_back(time(benchmark, result.iterations, result.items));
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+
+// The results as JSON, one line per microbenchmark with nanoseconds per item and items per
+// second as means with 95% intervals.
+inline std::string microbench_json(double min_time, size_t repeat, const std::vector<MicrobenchResult> &results)
+{
+    using namespace bench_detail;
+    char header[96];
+    std::snprintf(header, sizeof(header), "{\n  \"min_time\": %g,\n  \"repeat\": %zu,\n  \"benchmarks\": [\n", min_time,
+                  repeat);
+    std::string text = header;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const MicrobenchResult &result = results[i];
+        std::vector<double> nanoseconds;
+        std::vector<double> rate;
+        for (double seconds : result.seconds)
+        {
+            nanoseconds.push_back(seconds * 1e9 / std::max<uint64_t>(result.items, 1));
+            rate.push_back(result.items / std::max(seconds, 1e-9));
+        }
+        text += "    {\"name\": " + quoted(result.name) + ", \"iterations\": " + std::to_string(result.iterations) +
+                ", \"items\": " + std::to_string(result.items) + ", \"ns_per_item\": " + interval(nanoseconds) +
+                ", \"items_per_second\": " + interval(rate) + "}" + (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    return text + "  ]\n}\n";
+}
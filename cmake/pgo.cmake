@@ -0,0 +1,34 @@
+# Two-stage profile-guided build of SVEU16: configure with SVEU16_PGO=GENERATE, build, train
+# the instrumented sveu16 on the Forth workloads (target pgo-train), then configure the same
+# directory with SVEU16_PGO=USE, build and test.
+#   cmake [-DBUILD=build/pgo] [-DGENERATOR=Ninja] [-DOPTIONS="-DSVEU16_LTO=ON;..."] -P cmake/pgo.cmake
+# pgo-train runs this script with LLVM_PROFDATA set to merge Clang's raw profiles instead.
+if(DEFINED LLVM_PROFDATA)
+    file(GLOB raw "${DIR}/*.profraw")
+    if(NOT raw)
+        message(FATAL_ERROR "No raw profiles in ${DIR}")
+    endif()
+    execute_process(COMMAND "${LLVM_PROFDATA}" merge -o "${DIR}/default.profdata" ${raw} COMMAND_ERROR_IS_FATAL ANY)
+    return()
+endif()
+
+get_filename_component(source "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+if(NOT DEFINED BUILD)
+    set(BUILD "${source}/build/pgo")
+endif()
+set(generator)
+if(DEFINED GENERATOR)
+    set(generator -G "${GENERATOR}")
+endif()
+
+file(REMOVE_RECURSE "${BUILD}/pgo-profile")
+foreach(stage GENERATE USE)
+    message(STATUS "PGO ${stage}: ${BUILD}")
+    execute_process(COMMAND "${CMAKE_COMMAND}" -S "${source}" -B "${BUILD}" ${generator} -DCMAKE_BUILD_TYPE=Release
+                            -DSVEU16_PGO=${stage} ${OPTIONS} COMMAND_ERROR_IS_FATAL ANY)
+    execute_process(COMMAND "${CMAKE_COMMAND}" --build "${BUILD}" --parallel COMMAND_ERROR_IS_FATAL ANY)
+    if(stage STREQUAL "GENERATE")
+        execute_process(COMMAND "${CMAKE_COMMAND}" --build "${BUILD}" --target pgo-train COMMAND_ERROR_IS_FATAL ANY)
+    endif()
+endforeach()
+execute_process(COMMAND "${CMAKE_CTEST_COMMAND}" --test-dir "${BUILD}" --output-on-failure COMMAND_ERROR_IS_FATAL ANY)
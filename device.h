@@ -0,0 +1,14 @@
+// A memory-mapped device for the SVEU16 machine. Attached to an address, it gives what guest
+// reads of that address return and sees every store to it, which memory keeps as well. Its
+// reads are input the machine cannot replay: a Recording covers the keyboard only.
+#pragma once
+
+#include <cstdint>
+
+class Device
+{
+public:
+    virtual ~Device() = default;
+    virtual uint16_t read(uint16_t address, uint64_t cycle) = 0;
+    virtual void write(uint16_t address, uint16_t value, uint64_t cycle) = 0;
+};
@@ -0,0 +1,261 @@
+// eForth dictionary headers, as laid out in forth.asm and by HEAD, for new definitions:
+//   WRD <link: name address of the previous word, 0 ends the list>
+//   WRD <name length>            <- name address (na)
+//   TXT "<name>"                 one word per character
+//   WRD <flags: ECOMP $40, EIMED $80>
+//   WRD <code address>           <- code field address (cfa), LIST1 for colon words
+#pragma once
+
+#include "sveu16.h"
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+constexpr uint16_t MAX_NAME_LENGTH = 31;
+
+inline bool is_header(const Memory &memory, uint32_t na)
+{
+    uint16_t length = memory[na];
+    if (length == 0 || length > MAX_NAME_LENGTH || na + length + 2 >= memory.size())
+    {
+        return false;
+    }
+    for (uint16_t i = 1; i <= length; ++i)
+    {
+        if (memory[na + i] <= ' ' || memory[na + i] > '~')
+        {
+            return false;
+        }
+    }
+    return (memory[na + length + 1] & ~0xC0) == 0;
+}
+
+inline bool header_name_is(const Memory &memory, uint16_t na, std::string_view name)
+{
+    if (memory[na] != name.size() || na + name.size() >= memory.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < name.size(); ++i)
+    {
+        if (memory[na + 1 + i] != static_cast<uint8_t>(name[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline std::string header_name(const Memory &memory, uint16_t na)
+{
+    std::string name;
+    for (uint16_t i = 1; i <= memory[na] && na + i < memory.size(); ++i)
+    {
+        name.push_back(static_cast<char>(memory[na + i]));
+    }
+    return name;
+}
+
+inline uint16_t name_to_cfa(const Memory &memory, uint16_t na)
+{
+    return na + memory[na] + 2;
+}
+
+// Searches the image for the header of name. A match must also be linked to another header
+// (or end the list) so that counted strings compiled into colon words are not taken for it.
+// Returns the name address, or 0 when there is no such word.
+inline uint16_t find_name(const Machine &machine, const std::string &name)
+{
+    const Memory &memory = machine.memory;
+    for (uint32_t na = 1; na + name.size() + 2 < memory.size(); ++na)
+    {
+        if (header_name_is(memory, na, name) && is_header(memory, na))
+        {
+            uint16_t link = memory[na - 1];
+            if (link == 0 || is_header(memory, link))
+            {
+                return na;
+            }
+        }
+    }
+    return 0;
+}
+
+// Name addresses of all the headers in [0, end), by the address of their link field. A header
+// counts when it links to an older one or ends the list, as for find_name.
+inline std::map<uint16_t, uint16_t> find_headers(const Memory &memory, uint32_t end)
+{
+    std::map<uint16_t, uint16_t> headers;
+    for (uint32_t na = 1; na + 2 < end; ++na)
+    {
+        uint16_t link = memory[na - 1];
+        if (is_header(memory, na) && (link == 0 || (link < na && is_header(memory, link))))
+        {
+            headers[static_cast<uint16_t>(na - 1)] = static_cast<uint16_t>(na);
+        }
+    }
+    return headers;
+}
+
+// The code address most of the headers have in their code field: LIST1, as most words are
+// colon words.
+inline uint16_t colon_code(const Memory &memory, const std::map<uint16_t, uint16_t> &headers)
+{
+    std::unordered_map<uint16_t, int> counts;
+    uint16_t code = 0;
+    for (const auto &header : headers)
+    {
+        uint16_t field = memory[name_to_cfa(memory, header.second)];
+        if (++counts[field] > counts[code])
+        {
+            code = field;
+        }
+    }
+    return code;
+}
+
+// Code field address of a word: the table.txt label when it still points at a header with
+// this name, otherwise found by searching the image. Returns 0 when there is no such word.
+inline uint16_t resolve_word(const Machine &machine, const std::unordered_map<std::string, uint16_t> &symbols,
+                             const std::string &name, const std::string &label)
+{
+    auto it = symbols.find(label);
+    if (it != symbols.end() && it->second >= name.size() + 2)
+    {
+        uint16_t na = it->second - name.size() - 2;
+        if (header_name_is(machine.memory, na, name))
+        {
+            return it->second;
+        }
+    }
+    uint16_t na = find_name(machine, name);
+    return na == 0 ? 0 : name_to_cfa(machine.memory, na);
+}
+
+// Checks the threaded code of a colon word: every cell after the code field must be the code
+// field of the word named in body, or, for "=hex", exactly that value, or, for "+n", the
+// branch target cfa + n.
+inline bool match_body(const Memory &memory, uint16_t cfa, const std::vector<std::string> &body)
+{
+    if (cfa + body.size() >= memory.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < body.size(); ++i)
+    {
+        uint16_t cell = memory[cfa + 1 + i];
+        const std::string &expected = body[i];
+        if ((expected[0] == '=' || expected[0] == '+') && expected.size() > 1)
+        {
+            uint16_t value = static_cast<uint16_t>(std::stoul(expected.substr(1), nullptr, expected[0] == '=' ? 16 : 10));
+            if (cell != (expected[0] == '=' ? value : static_cast<uint16_t>(cfa + value)))
+            {
+                return false;
+            }
+        }
+        else if (cell < expected.size() + 2 || !header_name_is(memory, cell - expected.size() - 2, expected))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Emulator side index of the wordlists SFIND searches: for every wordlist (wid) a hash table
+// from name to the name address of the newest header with that name, in the order WID? would
+// find it. The cells it depends on (the wordlist head and the link, count, name and flags of
+// every header) are watched. A new head linked to the old one, as OVERT makes, is added;
+// any other store to them has the index rebuilt before the next search.
+class DictionaryIndex
+{
+public:
+    // Sets na to the name address of the newest word called name in wordlist wid, 0 if
+    // there is none. Returns false when the chain is not one the kernel builds (a header
+    // with a count HEAD never writes, a link into the device ports, a loop).
+    bool find(Machine &machine, uint16_t wid, const std::u16string &name, uint16_t &na)
+    {
+        sync(machine);
+        auto it = wordlists.find(wid);
+        if (it != wordlists.end() && machine.memory[wid] != it->second.head &&
+            !add(machine, wid, machine.memory[wid], it->second.head, it->second))
+        {
+            wordlists.erase(it);
+            it = wordlists.end();
+        }
+        if (it == wordlists.end())
+        {
+            Wordlist wordlist;
+            if (!add(machine, wid, machine.memory[wid], 0, wordlist))
+            {
+                return false;
+            }
+            it = wordlists.emplace(wid, std::move(wordlist)).first;
+        }
+
+        auto found = it->second.names.find(name);
+        na = found == it->second.names.end() ? 0 : found->second;
+        return true;
+    }
+
+private:
+    static constexpr size_t MAX_CHAIN = 8192;
+
+    struct Wordlist
+    {
+        uint16_t head = 0;
+        std::unordered_map<std::u16string, uint16_t> names;
+    };
+
+    const Machine *owner = nullptr;
+    std::unordered_map<uint16_t, Wordlist> wordlists; // by wid
+
+    // Drops everything when the machine is another one or a header cell was stored to.
+    void sync(Machine &machine)
+    {
+        bool changed = owner != &machine || machine.watched_stores.size() >= Machine::MAX_WATCHED_STORES;
+        for (uint16_t address : machine.watched_stores)
+        {
+            changed = changed || wordlists.count(address) == 0;
+        }
+        if (changed)
+        {
+            wordlists.clear();
+            machine.unwatch_all();
+            owner = &machine;
+        }
+        machine.watched_stores.clear();
+    }
+
+    // Indexes the headers from head down to (not including) until, newer names replacing
+    // older ones.
+    bool add(Machine &machine, uint16_t wid, uint16_t head, uint16_t until, Wordlist &wordlist)
+    {
+        const Memory &memory = machine.memory;
+        std::vector<uint16_t> headers;
+        for (uint16_t na = head; na != until; na = memory[na - 1])
+        {
+            if (na == 0 || headers.size() == MAX_CHAIN || memory[na] == 0 || memory[na] > MAX_NAME_LENGTH ||
+                na + memory[na] + 1 >= KEYBOARD_PORT)
+            {
+                return false;
+            }
+            headers.push_back(na);
+        }
+
+        machine.watch(wid);
+        for (auto it = headers.rbegin(); it != headers.rend(); ++it)
+        {
+            uint16_t na = *it;
+            std::u16string name(memory.begin() + na + 1, memory.begin() + na + 1 + memory[na]);
+            wordlist.names[name] = na;
+            for (uint16_t address = na - 1; address <= na + memory[na] + 1; ++address)
+            {
+                machine.watch(address);
+            }
+        }
+        wordlist.head = head;
+        return true;
+    }
+};
@@ -0,0 +1,331 @@
+// Listing of an SVEU16 image in the source format of forth.asm, so that assembling a whole
+// listing gives the image back. Dictionary headers are found by following their links;
+// colon word bodies are listed as threads of word names (with the inline literal, branch
+// target or string that _LIT, _IF, _ELSE and the _" words take), code word bodies and
+// everything outside the dictionary as instructions. The comment of every line has its
+// address and the word there.
+#pragma once
+
+#include "dictionary.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Address labels of table.txt, one per address, the one defined first in the source when
+// there are several. table.txt lists the labels from the last address down and then the
+// constants, so the labels end where the values start to go up again.
+inline std::unordered_map<uint16_t, std::string> load_address_labels(const std::string &filename)
+{
+    std::unordered_map<uint16_t, std::string> labels;
+    std::ifstream file(filename);
+    std::string name;
+    std::string value;
+    uint32_t last = 0x10000;
+    while (file >> name >> value)
+    {
+        uint32_t address = std::stoul(value, nullptr, 16);
+        if (address > last)
+        {
+            break;
+        }
+        labels[static_cast<uint16_t>(address)] = name;
+        last = address;
+    }
+    return labels;
+}
+
+namespace disassembler_detail
+{
+const char *const MNEMONICS[16] = {"LOD", "ADD", "SUB", "AND", "ORA", "XOR", "SHR", "MUL",
+                                   "STO", "MIF", "GTU", "GTS", "LTU", "LTS", "EQU", "MAJ"};
+
+constexpr uint32_t MIN_ZERO_RUN = 8;  // unlabelled zero words outside headers left to ORG
+constexpr uint16_t MAX_STRING = 255; // count of a counted string
+
+inline bool printable(uint16_t word)
+{
+    return word >= ' ' && word <= '~' && word != '"';
+}
+} // namespace disassembler_detail
+
+class Disassembler
+{
+public:
+    Disassembler(const Memory &memory, const std::unordered_map<uint16_t, std::string> &labels)
+        : memory(memory), labels(labels)
+    {
+        end = static_cast<uint32_t>(memory.size());
+        while (end > 0 && memory[end - 1] == 0 && labels.count(static_cast<uint16_t>(end - 1)) == 0)
+        {
+            --end;
+        }
+        headers = find_headers(memory, end);
+        list1 = colon_code(memory, headers);
+        for (const auto &header : headers)
+        {
+            words[name_to_cfa(memory, header.second)] = header_name(memory, header.second);
+        }
+    }
+
+    // Lists the statements that start in [from, to). Everything is analysed from address 0
+    // so that a range lists as it does in the whole listing.
+    std::string listing(uint32_t from = 0, uint32_t to = 0x10000)
+    {
+        text.clear();
+        range_from = from;
+        range_to = to;
+        uint32_t address = 0;
+        bool skipped = false;
+        while (address < end)
+        {
+            auto next = headers.lower_bound(static_cast<uint16_t>(address));
+            uint32_t limit = next == headers.end() ? end : next->first;
+            uint32_t zeros = zero_run(address, limit);
+            if (zeros >= disassembler_detail::MIN_ZERO_RUN)
+            {
+                address += zeros;
+                skipped = true;
+                continue;
+            }
+            if (skipped)
+            {
+                emit(address, 0, "ORG $" + hex(address), "");
+                skipped = false;
+            }
+            address = address == limit ? header(next->second) : code(address, limit);
+        }
+        return text;
+    }
+
+private:
+    const Memory &memory;
+    const std::unordered_map<uint16_t, std::string> &labels;
+    std::map<uint16_t, uint16_t> headers;
+    std::unordered_map<uint16_t, std::string> words; // Forth name by code field address
+    uint32_t end;
+    uint16_t list1 = 0;
+    std::string text;
+    uint32_t range_from = 0;
+    uint32_t range_to = 0x10000;
+
+    static std::string hex(uint32_t value, int digits = 4)
+    {
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "%0*X", digits, value);
+        return buffer;
+    }
+
+    std::string reference(uint16_t value) const
+    {
+        auto it = labels.find(value);
+        return it != labels.end() ? it->second : "$" + hex(value);
+    }
+
+    std::string word_name(uint16_t cfa) const
+    {
+        auto it = words.find(cfa);
+        return it != words.end() ? it->second : "";
+    }
+
+    void emit(uint32_t address, uint32_t length, const std::string &statement, const std::string &note)
+    {
+        if (address < range_from || address >= range_to)
+        {
+            return;
+        }
+        auto label = labels.find(static_cast<uint16_t>(address));
+        std::string line = label != labels.end() && length > 0 ? label->second : "";
+        line.resize(std::max<size_t>(line.size() + 1, 6), ' ');
+        line += statement;
+        line.resize(std::max<size_t>(line.size() + 1, 30), ' ');
+        line += "; " + hex(address);
+        for (uint32_t i = 0; i < length && i < 2; ++i)
+        {
+            line += " " + hex(memory[address + i]);
+        }
+        text += line + (length > 2 ? " ..." : "") + (note.empty() ? "" : "  " + note) + "\n";
+    }
+
+    void emit_word(uint32_t address, const std::string &value, const std::string &note = "")
+    {
+        emit(address, 1, "WRD " + value, note);
+    }
+
+    // Characters from address on up to count, as TXT runs (broken at labels and at
+    // characters TXT cannot hold) and WRD for the rest.
+    void characters(uint32_t address, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count;)
+        {
+            uint32_t run = 0;
+            while (i + run < count && disassembler_detail::printable(memory[address + i + run]) &&
+                   (run == 0 || labels.count(static_cast<uint16_t>(address + i + run)) == 0))
+            {
+                ++run;
+            }
+            if (run == 0)
+            {
+                emit_word(address + i, "$" + hex(memory[address + i], 2));
+                ++i;
+                continue;
+            }
+            std::string chars(memory.begin() + address + i, memory.begin() + address + i + run);
+            emit(address + i, run, "TXT \"" + chars + "\"", "");
+            i += run;
+        }
+    }
+
+    // Unlabelled zero words from address on.
+    uint32_t zero_run(uint32_t address, uint32_t limit) const
+    {
+        uint32_t length = 0;
+        while (address + length < limit && memory[address + length] == 0 &&
+               labels.count(static_cast<uint16_t>(address + length)) == 0)
+        {
+            ++length;
+        }
+        return length;
+    }
+
+    // The header at na, then its body up to the next header. Returns the address after it.
+    uint32_t header(uint16_t na)
+    {
+        uint16_t cfa = name_to_cfa(memory, na);
+        uint16_t flags = memory[cfa - 1];
+        emit_word(na - 1, reference(memory[na - 1]), "link");
+        emit_word(na, "$" + hex(memory[na], 2), header_name(memory, na));
+        characters(na + 1, memory[na]);
+        emit_word(cfa - 1, flags == 0 ? "0" : "$" + hex(flags, 2),
+                  flags == 0x40 ? "compile only" : flags == 0x80 ? "immediate" : flags ? "immediate, compile only" : "");
+
+        auto next = headers.upper_bound(cfa);
+        uint32_t limit = next == headers.end() ? end : next->first;
+        if (memory[cfa] == list1)
+        {
+            emit_word(cfa, reference(memory[cfa]), "colon");
+            return thread(cfa + 1, limit);
+        }
+        emit_word(cfa, reference(memory[cfa]), memory[cfa] == cfa + 1 ? "code" : "");
+        return code(cfa + 1, limit);
+    }
+
+    // A colon word body: word names and what they take inline.
+    uint32_t thread(uint32_t address, uint32_t limit)
+    {
+        bool data = false; // after _VAR, _CON and _USR the rest is theirs
+        while (address < limit)
+        {
+            uint16_t cell = memory[address];
+            std::string name = word_name(cell);
+            emit_word(address, data ? "$" + hex(cell) : reference(cell), data ? "" : name);
+            ++address;
+            if (data || address >= limit)
+            {
+                continue;
+            }
+            if (name == "_LIT")
+            {
+                std::string literal = word_name(memory[address]);
+                emit_word(address, reference(memory[address]),
+                          std::to_string(static_cast<int16_t>(memory[address])) + (literal.empty() ? "" : " ' " + literal));
+                ++address;
+            }
+            else if (name == "_IF" || name == "_ELSE")
+            {
+                emit_word(address, reference(memory[address]), "-> " + hex(memory[address]));
+                ++address;
+            }
+            else if (name.size() > 1 && name.front() == '_' && name.back() == '"' &&
+                     address + memory[address] < limit)
+            {
+                uint16_t count = memory[address];
+                emit_word(address, "$" + hex(count, 2), "string");
+                characters(address + 1, count);
+                address += count + 1;
+            }
+            data = name == "_VAR" || name == "_CON" || name == "_USR";
+        }
+        return address;
+    }
+
+    // Instructions, with the word after LOD Rx,Rx,R15 as its immediate.
+    uint32_t code(uint32_t address, uint32_t limit)
+    {
+        while (address < limit)
+        {
+            uint16_t instruction = memory[address];
+            uint16_t count = instruction;
+            if (labels.count(static_cast<uint16_t>(address)) && count > 0 && count <= disassembler_detail::MAX_STRING &&
+                address + count < limit && std::all_of(memory.begin() + address + 1, memory.begin() + address + 1 + count,
+                                                       [](uint16_t c) { return c >= ' ' && c <= '~'; }))
+            {
+                emit_word(address, std::to_string(count), "string");
+                characters(address + 1, count);
+                address += count + 1;
+                continue;
+            }
+            if (zero_run(address, limit) >= disassembler_detail::MIN_ZERO_RUN)
+            {
+                return address;
+            }
+            if (instruction == 0)
+            {
+                emit_word(address, "0");
+                ++address;
+                continue;
+            }
+            uint16_t d = (instruction >> 8) & 0x0F;
+            uint16_t a = (instruction >> 4) & 0x0F;
+            uint16_t b = instruction & 0x0F;
+            std::string statement = std::string(disassembler_detail::MNEMONICS[instruction >> 12]) + " R" +
+                                    std::to_string(d) + ",R" + std::to_string(a) + ",R" + std::to_string(b);
+            std::string note = instruction == 0x4F99 ? "NEXT" : "";
+            emit(address, 1, statement, note);
+            ++address;
+            if (instruction >> 12 == LOD && b == PC && address < limit)
+            {
+                std::string name = word_name(memory[address]);
+                emit_word(address, reference(memory[address]), name.empty() ? "operand" : "operand, " + name);
+                ++address;
+            }
+        }
+        return address;
+    }
+};
+
+// Hex dump of [from, to), eight words a line with the characters of those that hold one.
+// Lines equal to the one before are left out and marked with a single "*".
+inline std::string dump_memory(const Memory &memory, uint32_t from, uint32_t to)
+{
+    std::string text;
+    char buffer[16];
+    bool repeated = false;
+    to = std::min<uint32_t>(to, static_cast<uint32_t>(memory.size()));
+    for (uint32_t line = from; line < to; line += 8)
+    {
+        uint32_t count = std::min<uint32_t>(8, to - line);
+        if (line >= from + 8 && count == 8 &&
+            std::equal(memory.begin() + line, memory.begin() + line + 8, memory.begin() + line - 8))
+        {
+            text += repeated ? "" : "*\n";
+            repeated = true;
+            continue;
+        }
+        repeated = false;
+        std::snprintf(buffer, sizeof(buffer), "%04X:", line);
+        text += buffer;
+        std::string chars;
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            uint16_t word = i < count ? memory[line + i] : 0;
+            std::snprintf(buffer, sizeof(buffer), i < count ? " %04X" : "     ", word);
+            text += buffer;
+            chars.push_back(i >= count ? ' ' : word >= ' ' && word <= '~' ? static_cast<char>(word) : '.');
+        }
+        text += "  " + chars + "\n";
+    }
+    return text;
+}
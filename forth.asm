@@ -7555,7 +7555,7 @@ AR5   WRD LIST1  ; Process colon list
 AS24  WRD $02
       TXT "r6"
       WRD 0
-AR5   WRD LIST1  ; Process colon list
+AR6   WRD LIST1  ; Process colon list
       WRD ULIT
          WRD $6
       WRD TOASM
@@ -7627,7 +7627,7 @@ AR11  WRD LIST1  ; Process colon list
 AS30  WRD $03
       TXT "r12"
       WRD 0
-AR13  WRD LIST1  ; Process colon list
+AR12  WRD LIST1  ; Process colon list
       WRD ULIT
          WRD $C
       WRD TOASM
@@ -0,0 +1,596 @@
+// GDB remote serial protocol server for a Machine, over a local TCP port or a Unix socket.
+//   registers: R0-R15 (R15 is the pc), 16 bits each, sent in little-endian byte order
+//   memory:    addresses and lengths count 16-bit words, the unit SVEU16 addresses;
+//              each word is sent as two bytes, little-endian
+//   breakpoints (Z0/Z1, both kept as flags on the address, memory is not patched),
+//   write/read/access watchpoints (Z2/Z3/Z4, over kind words from the address),
+//   continue, single step, Ctrl-C, target.xml and no-ack mode,
+//   reverse step and reverse continue (bs/bc) when given a History; writes to registers or
+//   memory start the history again, as a replay would not make them.
+// A native hook runs as one step, and what it reads is not seen by read watchpoints; use
+// --no-native to stop inside the words it replaces. There is no SVEU16 architecture in GDB
+// itself, so the client must take its registers from target.xml.
+#pragma once
+
+#include "history.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace gdb_detail
+{
+constexpr size_t PACKET_SIZE = 4096;   // largest packet we take, advertised in qSupported
+constexpr uint64_t RUN_CHUNK = 100000; // cycles between checks for Ctrl-C while running
+constexpr int SIGINT_SIGNAL = 2;
+constexpr int SIGTRAP_SIGNAL = 5;
+
+inline std::string hex_byte(unsigned value)
+{
+    char text[3];
+    std::snprintf(text, sizeof(text), "%02x", value & 0xFF);
+    return text;
+}
+
+inline std::string hex_word(uint16_t value)
+{
+    return hex_byte(value) + hex_byte(value >> 8);
+}
+
+inline int hex_digit(char c)
+{
+    return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+// Parses a hex number from text at, moving at past it. Returns false when there is none.
+inline bool parse_hex(const std::string &text, size_t &at, uint32_t &value)
+{
+    size_t start = at;
+    value = 0;
+    while (at < text.size() && hex_digit(text[at]) >= 0 && at - start < 8)
+    {
+        value = value << 4 | static_cast<uint32_t>(hex_digit(text[at++]));
+    }
+    return at > start;
+}
+
+// Little-endian word from four hex digits at text[at].
+inline bool parse_word(const std::string &text, size_t at, uint16_t &value)
+{
+    if (at + 4 > text.size() || !std::all_of(text.begin() + at, text.begin() + at + 4, [](char c) { return hex_digit(c) >= 0; }))
+    {
+        return false;
+    }
+    value = static_cast<uint16_t>(hex_digit(text[at]) << 4 | hex_digit(text[at + 1]) | hex_digit(text[at + 2]) << 12 |
+                                  hex_digit(text[at + 3]) << 8);
+    return true;
+}
+
+inline std::string target_xml()
+{
+    std::string xml = "<?xml version=\"1.0\"?>\n<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+                      "<target version=\"1.0\">\n<feature name=\"org.sveu16.core\">\n";
+    for (int i = 0; i < 16; ++i)
+    {
+        xml += "<reg name=\"" + (i == PC ? std::string("pc") : "r" + std::to_string(i)) +
+               "\" bitsize=\"16\" regnum=\"" + std::to_string(i) + "\" type=\"" +
+               (i == PC ? "code_ptr" : "uint16") + "\"/>\n";
+    }
+    return xml + "</feature>\n</target>\n";
+}
+} // namespace gdb_detail
+
+class GdbStub
+{
+public:
+    explicit GdbStub(Machine &machine, History *history = nullptr) : machine(machine), history(history)
+    {
+        if (history)
+        {
+            history->start(machine);
+        }
+    }
+
+    // Serves the client connected on fd until it detaches, kills the session or goes away.
+    // Breakpoints and watchpoints it set are removed again. Returns false when the connection
+    // failed rather than being ended by the client.
+    bool serve(int fd)
+    {
+        this->fd = fd;
+        input.clear();
+        acks = true;
+        connected = true;
+        bool ended = false;
+        std::string packet;
+        while (!ended && receive(packet))
+        {
+            ended = handle(packet);
+        }
+        for (uint16_t address : breakpoints)
+        {
+            machine.set_breakpoint(address, false);
+        }
+        for (const std::set<uint16_t> *watches : {&write_watches, &read_watches, &access_watches})
+        {
+            for (uint16_t address : *watches)
+            {
+                machine.set_watchpoint(address, false, false, false);
+            }
+        }
+        breakpoints.clear();
+        write_watches.clear();
+        read_watches.clear();
+        access_watches.clear();
+        return ended && connected;
+    }
+
+private:
+    Machine &machine;
+    History *history;
+    int fd = -1;
+    std::string input; // received and not yet handled
+    bool acks = true;
+    bool connected = true;
+    bool swbreak = false; // the client takes "swbreak" stop reasons
+    std::string last_stop = "S05";
+    std::set<uint16_t> breakpoints;
+    // watchpoints by the packet that set them (Z2, Z3, Z4): each is removed on its own
+    std::set<uint16_t> write_watches;
+    std::set<uint16_t> read_watches;
+    std::set<uint16_t> access_watches;
+
+    bool fill()
+    {
+        char buffer[4096];
+        ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+        if (length <= 0)
+        {
+            connected = false;
+            return false;
+        }
+        input.append(buffer, static_cast<size_t>(length));
+        return true;
+    }
+
+    // The next packet with a good checksum, acknowledged. Acks from the client are skipped;
+    // a Ctrl-C while stopped is answered with the stop.
+    bool receive(std::string &packet)
+    {
+        while (true)
+        {
+            size_t start = input.find('$');
+            if (input.find('\x03') < start)
+            {
+                input.erase(0, input.find('\x03') + 1);
+                send(last_stop);
+                continue;
+            }
+            size_t end = start == std::string::npos ? start : input.find('#', start);
+            if (end == std::string::npos || end + 3 > input.size())
+            {
+                if (!fill())
+                {
+                    return false;
+                }
+                continue;
+            }
+            packet = input.substr(start + 1, end - start - 1);
+            unsigned sum = 0;
+            for (char c : packet)
+            {
+                sum += static_cast<uint8_t>(c);
+            }
+            size_t at = end + 1;
+            uint32_t checksum = 0;
+            bool good = gdb_detail::parse_hex(input.substr(0, end + 3), at, checksum) && at == end + 3 &&
+                        checksum == (sum & 0xFF);
+            input.erase(0, end + 3);
+            if (acks && !write_all(good ? "+" : "-"))
+            {
+                return false;
+            }
+            if (good)
+            {
+                return true;
+            }
+        }
+    }
+
+    bool write_all(const std::string &text)
+    {
+        for (size_t sent = 0; sent < text.size();)
+        {
+            ssize_t length = ::send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+            if (length <= 0)
+            {
+                return false;
+            }
+            sent += static_cast<size_t>(length);
+        }
+        return true;
+    }
+
+    bool send(const std::string &payload)
+    {
+        unsigned sum = 0;
+        std::string escaped;
+        for (char c : payload)
+        {
+            if (c == '$' || c == '#' || c == '}' || c == '*')
+            {
+                escaped += '}';
+                c ^= 0x20;
+            }
+            escaped += c;
+        }
+        for (char c : escaped)
+        {
+            sum += static_cast<uint8_t>(c);
+        }
+        return write_all("$" + escaped + "#" + gdb_detail::hex_byte(sum));
+    }
+
+    // Handles one packet. Returns true when the session ends.
+    bool handle(const std::string &packet)
+    {
+        using namespace gdb_detail;
+        char command = packet.empty() ? 0 : packet[0];
+        size_t at = 1;
+        uint32_t a = 0;
+        uint32_t b = 0;
+        std::string reply;
+        switch (command)
+        {
+        case '?':
+            reply = last_stop;
+            break;
+        case 'g':
+            for (uint16_t value : machine.registers)
+            {
+                reply += hex_word(value);
+            }
+            break;
+        case 'G':
+        {
+            uint16_t values[16];
+            reply = packet.size() == 1 + 16 * 4 ? "OK" : "E01";
+            for (int i = 0; i < 16 && reply == "OK"; ++i)
+            {
+                reply = parse_word(packet, 1 + 4 * i, values[i]) ? "OK" : "E01";
+            }
+            if (reply == "OK")
+            {
+                std::copy(std::begin(values), std::end(values), machine.registers);
+                changed();
+            }
+            break;
+        }
+        case 'p':
+            reply = parse_hex(packet, at, a) && a < 16 ? hex_word(machine.registers[a]) : "E01";
+            break;
+        case 'P':
+        {
+            uint16_t value;
+            reply = parse_hex(packet, at, a) && a < 16 && packet[at] == '=' && parse_word(packet, at + 1, value) &&
+                            packet.size() == at + 5
+                        ? "OK"
+                        : "E01";
+            if (reply == "OK")
+            {
+                machine.registers[a] = value;
+                changed();
+            }
+            break;
+        }
+        case 'm':
+            reply = parse_range(packet, a, b) ? read_memory(a, b) : "E01";
+            break;
+        case 'M':
+            reply = parse_range(packet, a, b) && write_memory(packet, a, b) ? "OK" : "E01";
+            if (reply == "OK")
+            {
+                changed();
+            }
+            break;
+        case 'c':
+        case 's':
+            if (parse_hex(packet, at, a))
+            {
+                machine.registers[PC] = static_cast<uint16_t>(a);
+                changed();
+            }
+            reply = last_stop = command == 'c' ? resume() : single_step();
+            break;
+        case 'b':
+            if (history && (packet == "bs" || packet == "bc"))
+            {
+                machine.stop = Stop();
+                bool back = packet == "bs" ? history->reverse_step(machine) : history->reverse_continue(machine);
+                reply = last_stop = back ? stopped() : "T" + hex_byte(SIGTRAP_SIGNAL) + "replaylog:begin;";
+            }
+            break;
+        case 'Z':
+        case 'z':
+            reply = set_point(packet, command == 'Z');
+            break;
+        case 'H':
+        case 'T':
+            reply = "OK";
+            break;
+        case 'q':
+            reply = query(packet);
+            break;
+        case 'Q':
+            if (packet == "QStartNoAckMode")
+            {
+                send("OK");
+                acks = false;
+                return false;
+            }
+            break;
+        case 'D':
+            send("OK");
+            return true;
+        case 'k':
+            return true;
+        }
+        return !send(reply);
+    }
+
+    std::string query(const std::string &packet)
+    {
+        const std::string features = "qXfer:features:read:target.xml:";
+        if (packet.rfind("qSupported", 0) == 0)
+        {
+            swbreak = packet.find("swbreak+") != std::string::npos;
+            return "PacketSize=" + std::to_string(gdb_detail::PACKET_SIZE) +
+                   ";qXfer:features:read+;QStartNoAckMode+;swbreak+;hwbreak+" +
+                   (history ? ";ReverseStep+;ReverseContinue+" : "");
+        }
+        if (packet.rfind(features, 0) == 0)
+        {
+            size_t at = features.size();
+            uint32_t offset = 0;
+            uint32_t length = 0;
+            if (!gdb_detail::parse_hex(packet, at, offset) || packet[at] != ',' ||
+                !gdb_detail::parse_hex(packet, ++at, length))
+            {
+                return "E01";
+            }
+            std::string xml = gdb_detail::target_xml();
+            if (offset >= xml.size())
+            {
+                return "l";
+            }
+            std::string part = xml.substr(offset, length);
+            return (offset + part.size() < xml.size() ? "m" : "l") + part;
+        }
+        if (packet == "qAttached")
+        {
+            return "1";
+        }
+        if (packet == "qC")
+        {
+            return "QC1";
+        }
+        if (packet == "qfThreadInfo")
+        {
+            return "m1";
+        }
+        if (packet == "qsThreadInfo")
+        {
+            return "l";
+        }
+        return "";
+    }
+
+    // "addr,length" after the command letter, the range inside the 64K words.
+    static bool parse_range(const std::string &packet, uint32_t &address, uint32_t &length)
+    {
+        size_t at = 1;
+        return gdb_detail::parse_hex(packet, at, address) && packet[at] == ',' &&
+               gdb_detail::parse_hex(packet, ++at, length) && address <= 0xFFFF && length <= 0x10000 - address &&
+               length <= gdb_detail::PACKET_SIZE / 4;
+    }
+
+    // Memory as the debugger sees it: the ports read as the memory behind them, without
+    // taking a key.
+    std::string read_memory(uint32_t address, uint32_t length) const
+    {
+        std::string reply;
+        for (uint32_t i = 0; i < length; ++i)
+        {
+            reply += gdb_detail::hex_word(machine.memory[address + i]);
+        }
+        return reply;
+    }
+
+    // Stores the words after the ':', all of them or, when one is not valid, none; the
+    // machine is told of them like of a native hook's stores (so the dictionary index
+    // notices), but they do not stop it at a watchpoint.
+    bool write_memory(const std::string &packet, uint32_t address, uint32_t length)
+    {
+        size_t data = packet.find(':');
+        if (data == std::string::npos || packet.size() - data - 1 != 4 * length)
+        {
+            return false;
+        }
+        std::vector<uint16_t> words(length);
+        for (uint32_t i = 0; i < length; ++i)
+        {
+            if (!gdb_detail::parse_word(packet, data + 1 + 4 * i, words[i]))
+            {
+                return false;
+            }
+        }
+        std::copy(words.begin(), words.end(), machine.memory.begin() + address);
+        Stop stop = machine.stop;
+        machine.stored(static_cast<uint16_t>(address), length);
+        machine.stop = stop;
+        return true;
+    }
+
+    std::string set_point(const std::string &packet, bool insert)
+    {
+        size_t at = 3;
+        uint32_t address = 0;
+        uint32_t kind = 0;
+        char type = packet.size() > 1 ? packet[1] : 0;
+        if (packet.size() < 3 || packet[2] != ',' || !gdb_detail::parse_hex(packet, at, address) || packet[at] != ',' ||
+            !gdb_detail::parse_hex(packet, ++at, kind) || address > 0xFFFF)
+        {
+            return "E01";
+        }
+        if (type == '0' || type == '1')
+        {
+            machine.set_breakpoint(static_cast<uint16_t>(address), insert);
+            insert ? (void)breakpoints.insert(static_cast<uint16_t>(address))
+                   : (void)breakpoints.erase(static_cast<uint16_t>(address));
+            return "OK";
+        }
+        if (type < '2' || type > '4')
+        {
+            return "";
+        }
+        std::set<uint16_t> &watches = type == '2' ? write_watches : type == '3' ? read_watches : access_watches;
+        for (uint32_t i = address; i < address + std::max<uint32_t>(kind, 1) && i <= 0xFFFF; ++i)
+        {
+            uint16_t word = static_cast<uint16_t>(i);
+            insert ? (void)watches.insert(word) : (void)watches.erase(word);
+            bool access = access_watches.count(word) != 0;
+            bool write = access || write_watches.count(word);
+            bool read = access || read_watches.count(word);
+            machine.set_watchpoint(word, write, read, write || read);
+        }
+        return "OK";
+    }
+
+    // The stop reply for why the machine stopped.
+    std::string stopped()
+    {
+        using namespace gdb_detail;
+        Stop stop = machine.stop;
+        machine.stop = Stop();
+        std::string reply = "T" + hex_byte(SIGTRAP_SIGNAL);
+        switch (stop.reason)
+        {
+        case StopReason::BREAKPOINT:
+            return swbreak ? reply + "swbreak:;" : reply;
+        case StopReason::WATCH_WRITE:
+        case StopReason::WATCH_READ:
+        {
+            char address[8];
+            std::snprintf(address, sizeof(address), "%x", stop.address);
+            const char *kind = access_watches.count(stop.address) ? "awatch" : stop.reason == StopReason::WATCH_WRITE ? "watch" : "rwatch";
+            return reply + kind + ":" + address + ";";
+        }
+        default:
+            return reply;
+        }
+    }
+
+    void changed()
+    {
+        if (history)
+        {
+            history->start(machine);
+        }
+    }
+
+    std::string single_step()
+    {
+        machine.stop = Stop();
+        history ? history->step(machine) : machine.step_over();
+        return stopped();
+    }
+
+    // Runs until a breakpoint or watchpoint stops the machine or the client sends Ctrl-C.
+    // Acks that come in meanwhile are dropped, anything else waits for the stop.
+    std::string resume()
+    {
+        machine.stop = Stop();
+        history ? history->step(machine) : machine.step_over();
+        while (machine.stop.reason == StopReason::NONE)
+        {
+            history ? history->run(machine, gdb_detail::RUN_CHUNK) : machine.run(gdb_detail::RUN_CHUNK);
+            pollfd waiting = {fd, POLLIN, 0};
+            if (input.empty() && poll(&waiting, 1, 0) > 0 && !fill())
+            {
+                return last_stop; // not sent, the client is gone
+            }
+            while (!input.empty() && (input[0] == '+' || input[0] == '-'))
+            {
+                input.erase(0, 1);
+            }
+            if (machine.stop.reason == StopReason::NONE && !input.empty() && input[0] == '\x03')
+            {
+                input.erase(0, 1);
+                return "S" + gdb_detail::hex_byte(gdb_detail::SIGINT_SIGNAL);
+            }
+        }
+        return stopped();
+    }
+};
+
+// A listening socket on 127.0.0.1:port, or -1 with error set.
+inline int gdb_listen_tcp(uint16_t port, std::string &error)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+        bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 1) != 0)
+    {
+        error = "cannot listen on port " + std::to_string(port) + ": " + std::strerror(errno);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// A listening Unix socket at path (a socket left there by an earlier run is replaced), or -1
+// with error set.
+inline int gdb_listen_unix(const std::string &path, std::string &error)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        error = "socket path too long: " + path;
+        return -1;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    struct stat status;
+    if (stat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+    {
+        unlink(path.c_str());
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 1) != 0)
+    {
+        error = "cannot listen on " + path + ": " + std::strerror(errno);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
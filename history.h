@@ -0,0 +1,377 @@
+// Execution history for reverse stepping: checkpoints of the machine taken every interval
+// cycles while History runs it, and a log of the keys typed in between. Going back restores
+// the checkpoint before the point wanted and runs forward to it again, typing the logged
+// keys at the cycles they were first typed at; the machine (native hooks included) does the
+// same thing again from the same state, so it gets to the same place.
+//   memory: the oldest checkpoint has a full image, every later one the pages that changed
+//           since the one before it. When the checkpoints and the log outgrow the budget the
+//           oldest checkpoint is folded into the next one, so the history starts later.
+//   going back drops the checkpoints after the point reached (running forward takes them
+//   again) but keeps the log, so typed keys come again; typing there drops the rest of the log.
+// Stores from restoring are reported through Machine::stored() for the dictionary index.
+#pragma once
+
+#include "sveu16.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+class History
+{
+public:
+    static constexpr uint32_t PAGE_WORDS = 256;
+    static constexpr uint32_t PAGES = 65536 / PAGE_WORDS;
+
+    // budget is in bytes and counts the three full images History keeps (384K) too.
+    explicit History(size_t budget = 64 << 20, uint64_t interval = 1000000)
+        : budget(budget), interval(std::max<uint64_t>(interval, 1))
+    {
+    }
+
+    // Forgets the history; it starts again at the machine as it is. For changes to the machine
+    // from outside (a debugger writing registers or memory) that a replay would not make.
+    void start(const Machine &machine)
+    {
+        checkpoints.clear();
+        events.clear();
+        next_event = 0;
+        base.assign(machine.memory.begin(), machine.memory.end());
+        latest = base;
+        image = base;
+        checkpoints.push_back(capture(machine));
+        used = 3 * base.size() * sizeof(uint16_t) + size_of(checkpoints.back());
+    }
+
+    // Types text now, dropping any keys logged for later.
+    void type(Machine &machine, const std::string &text)
+    {
+        drop_future_events();
+        events.push_back({machine.cycles, text});
+        used += sizeof(Event) + text.size();
+        apply_events(machine);
+    }
+
+    // Machine::run(count) with the logged keys typed and checkpoints taken on the way. Stops
+    // early as run() does, at a breakpoint or watchpoint.
+    void run(Machine &machine, uint64_t count)
+    {
+        uint64_t end = machine.cycles + count;
+        while (machine.cycles < end && machine.stop.reason == StopReason::NONE)
+        {
+            forward_chunk(machine, end);
+        }
+    }
+
+    // Machine::step_over() with the logged keys typed and checkpoints taken.
+    void step(Machine &machine)
+    {
+        apply_events(machine);
+        machine.step_over();
+        checkpoint_if_due(machine);
+    }
+
+    // Back to the step before the machine's last one. Returns false at the start of the
+    // history, where the machine stays.
+    bool reverse_step(Machine &machine)
+    {
+        uint64_t now = machine.cycles;
+        size_t index = before(now);
+        if (index == checkpoints.size())
+        {
+            return false;
+        }
+        restore(machine, index);
+        uint64_t last = machine.cycles;
+        while (machine.cycles < now)
+        {
+            last = machine.cycles;
+            apply_events(machine);
+            machine.step_over();
+            machine.stop = Stop();
+        }
+        restore(machine, index);
+        replay(machine, last, nullptr);
+        truncate(index);
+        return true;
+    }
+
+    // Back to the last stop at a breakpoint or watchpoint before now, which machine.stop is
+    // set to. Returns false when there is none in the history; the machine is then at its
+    // start.
+    bool reverse_continue(Machine &machine)
+    {
+        uint64_t now = machine.cycles;
+        for (size_t index = before(now); index < checkpoints.size(); --index)
+        {
+            uint64_t end = index + 1 < checkpoints.size() ? std::min(now, checkpoints[index + 1].cycles) : now;
+            std::vector<std::pair<uint64_t, Stop>> hits;
+            restore(machine, index);
+            replay(machine, end, &hits);
+            while (!hits.empty() && hits.back().first >= now)
+            {
+                hits.pop_back();
+            }
+            if (!hits.empty())
+            {
+                restore(machine, index);
+                replay(machine, hits.back().first, nullptr);
+                machine.stop = hits.back().second;
+                truncate(index);
+                return true;
+            }
+            if (index == 0)
+            {
+                break;
+            }
+        }
+        if (!checkpoints.empty())
+        {
+            restore(machine, 0);
+            truncate(0);
+        }
+        return false;
+    }
+
+    uint64_t oldest() const
+    {
+        return checkpoints.empty() ? 0 : checkpoints.front().cycles;
+    }
+
+    size_t checkpoint_count() const
+    {
+        return checkpoints.size();
+    }
+
+    size_t memory_used() const
+    {
+        return used;
+    }
+
+private:
+    struct Checkpoint
+    {
+        uint64_t cycles;
+        uint16_t registers[16];
+        uint64_t empty_polls;
+        std::deque<uint16_t> keyboard;
+        size_t input_replayed; // when the keys come from a recording
+        size_t console; // length of Machine::console
+        std::vector<uint16_t> pages; // changed since the checkpoint before
+        std::vector<uint16_t> words; // their contents, PAGE_WORDS each
+    };
+
+    struct Event
+    {
+        uint64_t cycles;
+        std::string text;
+    };
+
+    size_t budget;
+    uint64_t interval;
+    size_t used = 0;
+    std::deque<Checkpoint> checkpoints;
+    std::vector<uint16_t> base;   // memory at the oldest checkpoint
+    std::vector<uint16_t> latest; // memory at the newest checkpoint
+    std::vector<uint16_t> image;  // scratch for restore()
+    std::deque<Event> events;
+    size_t next_event = 0; // the first event not typed yet
+
+    Checkpoint capture(const Machine &machine) const
+    {
+        Checkpoint checkpoint;
+        checkpoint.cycles = machine.cycles;
+        std::copy(std::begin(machine.registers), std::end(machine.registers), checkpoint.registers);
+        checkpoint.empty_polls = machine.empty_polls;
+        checkpoint.keyboard.assign(machine.keyboard.begin(), machine.keyboard.end());
+        checkpoint.input_replayed = machine.input_replayed;
+        checkpoint.console = machine.console.size();
+        return checkpoint;
+    }
+
+    size_t size_of(const Checkpoint &checkpoint) const
+    {
+        return sizeof(Checkpoint) + checkpoint.words.size() * sizeof(uint16_t) + checkpoint.pages.size() * sizeof(uint16_t) +
+               checkpoint.keyboard.size() * sizeof(uint16_t);
+    }
+
+    void checkpoint_if_due(const Machine &machine)
+    {
+        if (checkpoints.empty() || machine.cycles < checkpoints.back().cycles + interval)
+        {
+            return;
+        }
+        Checkpoint checkpoint = capture(machine);
+        for (uint32_t page = 0; page < PAGES; ++page)
+        {
+            const uint16_t *now = machine.memory.data() + page * PAGE_WORDS;
+            uint16_t *then = latest.data() + page * PAGE_WORDS;
+            if (std::memcmp(now, then, PAGE_WORDS * sizeof(uint16_t)) != 0)
+            {
+                checkpoint.pages.push_back(static_cast<uint16_t>(page));
+                checkpoint.words.insert(checkpoint.words.end(), now, now + PAGE_WORDS);
+                std::copy(now, now + PAGE_WORDS, then);
+            }
+        }
+        used += size_of(checkpoint);
+        checkpoints.push_back(std::move(checkpoint));
+        while (used > budget && checkpoints.size() > 1)
+        {
+            drop_oldest();
+        }
+    }
+
+    // Folds the oldest checkpoint into the next one, which becomes the oldest.
+    void drop_oldest()
+    {
+        used -= size_of(checkpoints.front());
+        checkpoints.pop_front();
+        Checkpoint &oldest = checkpoints.front();
+        for (size_t i = 0; i < oldest.pages.size(); ++i)
+        {
+            std::copy(oldest.words.begin() + i * PAGE_WORDS, oldest.words.begin() + (i + 1) * PAGE_WORDS,
+                      base.begin() + oldest.pages[i] * PAGE_WORDS);
+        }
+        used -= size_of(oldest);
+        oldest.pages.clear();
+        oldest.words.clear();
+        oldest.pages.shrink_to_fit();
+        oldest.words.shrink_to_fit();
+        used += size_of(oldest);
+        while (!events.empty() && events.front().cycles < oldest.cycles)
+        {
+            used -= sizeof(Event) + events.front().text.size();
+            events.pop_front();
+            next_event -= next_event > 0;
+        }
+    }
+
+    void drop_future_events()
+    {
+        while (events.size() > next_event)
+        {
+            used -= sizeof(Event) + events.back().text.size();
+            events.pop_back();
+        }
+    }
+
+    // Drops the checkpoints after index, the machine being between it and the next.
+    void truncate(size_t index)
+    {
+        while (checkpoints.size() > index + 1)
+        {
+            used -= size_of(checkpoints.back());
+            checkpoints.pop_back();
+        }
+        latest = image;
+    }
+
+    void apply_events(Machine &machine)
+    {
+        while (next_event < events.size() && events[next_event].cycles <= machine.cycles)
+        {
+            machine.type(events[next_event++].text);
+        }
+    }
+
+    // Runs toward end, up to the next event or checkpoint.
+    void forward_chunk(Machine &machine, uint64_t end)
+    {
+        apply_events(machine);
+        checkpoint_if_due(machine);
+        uint64_t until = std::min(end, checkpoints.empty() ? end : checkpoints.back().cycles + interval);
+        if (next_event < events.size())
+        {
+            until = std::min(until, events[next_event].cycles);
+        }
+        machine.run(until - machine.cycles);
+    }
+
+    // The newest checkpoint before cycle, or checkpoints.size() when there is none.
+    size_t before(uint64_t cycle) const
+    {
+        size_t index = checkpoints.size();
+        while (index > 0 && checkpoints[index - 1].cycles >= cycle)
+        {
+            --index;
+        }
+        return index == 0 ? checkpoints.size() : index - 1;
+    }
+
+    // Puts the machine back to checkpoint index.
+    void restore(Machine &machine, size_t index)
+    {
+        image = base;
+        for (size_t i = 1; i <= index; ++i)
+        {
+            const Checkpoint &checkpoint = checkpoints[i];
+            for (size_t j = 0; j < checkpoint.pages.size(); ++j)
+            {
+                std::copy(checkpoint.words.begin() + j * PAGE_WORDS, checkpoint.words.begin() + (j + 1) * PAGE_WORDS,
+                          image.begin() + checkpoint.pages[j] * PAGE_WORDS);
+            }
+        }
+        Stop stop = machine.stop;
+        for (uint32_t page = 0; page < PAGES; ++page)
+        {
+            uint16_t *now = machine.memory.data() + page * PAGE_WORDS;
+            const uint16_t *then = image.data() + page * PAGE_WORDS;
+            if (std::memcmp(now, then, PAGE_WORDS * sizeof(uint16_t)) != 0)
+            {
+                std::copy(then, then + PAGE_WORDS, now);
+                machine.stored(static_cast<uint16_t>(page * PAGE_WORDS), PAGE_WORDS);
+            }
+        }
+        machine.stop = stop;
+
+        const Checkpoint &checkpoint = checkpoints[index];
+        machine.cycles = checkpoint.cycles;
+        std::copy(std::begin(checkpoint.registers), std::end(checkpoint.registers), machine.registers);
+        machine.empty_polls = checkpoint.empty_polls;
+        machine.keyboard.assign(checkpoint.keyboard.begin(), checkpoint.keyboard.end());
+        machine.input_replayed = checkpoint.input_replayed;
+        machine.console.resize(checkpoint.console);
+        next_event = 0;
+        while (next_event < events.size() && events[next_event].cycles < checkpoint.cycles)
+        {
+            ++next_event;
+        }
+    }
+
+    // Runs forward to cycle target, a step boundary of the run being replayed, through the
+    // breakpoints and watchpoints on the way (listed in hits when given). Takes no checkpoints.
+    void replay(Machine &machine, uint64_t target, std::vector<std::pair<uint64_t, Stop>> *hits)
+    {
+        machine.stop = Stop();
+        while (machine.cycles < target)
+        {
+            apply_events(machine);
+            uint64_t until = target;
+            if (next_event < events.size())
+            {
+                until = std::min(until, std::max(events[next_event].cycles, machine.cycles + 1));
+            }
+            machine.run(until - machine.cycles);
+            if (machine.stop.reason != StopReason::NONE)
+            {
+                if (hits)
+                {
+                    hits->push_back({machine.cycles, machine.stop});
+                }
+                bool breakpoint = machine.stop.reason == StopReason::BREAKPOINT;
+                machine.stop = Stop();
+                if (breakpoint && machine.cycles < target)
+                {
+                    machine.step_over();
+                    if (machine.stop.reason != StopReason::NONE && hits)
+                    {
+                        hits->push_back({machine.cycles, machine.stop});
+                    }
+                    machine.stop = Stop();
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,480 @@
+// SVEU16 images on disk, in any of three formats:
+//   raw        the words from address 0, a whole number of them and at most 64K. forth.mem
+//              and save_image are little-endian; big-endian ones (for ROM programmers that
+//              want the high byte first) load when read with ByteOrder::BIG
+//   container  a header, the words, then table.txt's text when flags say so:
+//                0  "SVEU16IM"  magic
+//                8  u16 version (1)
+//               10  u16 flags (IMAGE_SYMBOLS)
+//               12  u16 load address, 14 u16 entry point (the program counter to start at)
+//               16  u32 words, 20 u32 checksum of the words as stored, 24 u32 symbol bytes
+//               28  u32 0
+//              every field and word little-endian; the words must fit between the load
+//              address and the end of memory, and nothing may follow the symbols.
+//   Intel HEX  a file named *.hex: records of bytes at byte addresses (word address * 2),
+//              each word's bytes in the byte order it is read with
+// Files are mapped (private, read-only) and copied from the mapping; nothing goes through
+// stdio or iostreams. Words are converted with an explicit byte order, never by casting the
+// bytes, so images mean the same on hosts of either endianness; where the host's order is
+// the other one the bytes are swapped 16 at a time (SSE2, SSSE3 pshufb or NEON).
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+constexpr char IMAGE_MAGIC[8] = {'S', 'V', 'E', 'U', '1', '6', 'I', 'M'};
+constexpr uint16_t IMAGE_VERSION = 1;
+constexpr uint16_t IMAGE_SYMBOLS = 1;
+constexpr size_t IMAGE_HEADER_BYTES = 32;
+constexpr size_t MEMORY_WORDS = 65536;
+
+enum class ByteOrder : uint8_t
+{
+    LITTLE, // low byte first, as forth.mem
+    BIG     // high byte first
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr ByteOrder NATIVE_ORDER = ByteOrder::BIG;
+#else
+constexpr ByteOrder NATIVE_ORDER = ByteOrder::LITTLE;
+#endif
+
+struct ImageInfo
+{
+    bool container = false;
+    uint16_t load_address = 0;
+    uint16_t entry = 0;
+    uint32_t words = 0;
+    std::string symbols; // table.txt text, when the container has it
+};
+
+// Swaps the two bytes of each of words words from in to out, which may be the same buffer.
+inline void swap_word_bytes(const uint8_t *in, uint8_t *out, size_t words)
+{
+    size_t i = 0;
+#if defined(__SSSE3__)
+    const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for (; i + 8 <= words; i += 8)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), _mm_shuffle_epi8(block, swap));
+    }
+#elif defined(__SSE2__)
+    for (; i + 8 <= words; i += 8)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * i));
+        block = _mm_or_si128(_mm_slli_epi16(block, 8), _mm_srli_epi16(block, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), block);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= words; i += 8)
+    {
+        vst1q_u8(out + 2 * i, vrev16q_u8(vld1q_u8(in + 2 * i)));
+    }
+#endif
+    for (size_t byte = 2 * i; byte < 2 * words; byte += 2)
+    {
+        uint8_t low = in[byte];
+        out[byte] = in[byte + 1];
+        out[byte + 1] = low;
+    }
+}
+
+// count words from bytes stored in order.
+inline void decode_words(const uint8_t *bytes, size_t count, ByteOrder order, uint16_t *words)
+{
+    if (order == NATIVE_ORDER)
+    {
+        std::memcpy(words, bytes, 2 * count);
+    }
+    else
+    {
+        swap_word_bytes(bytes, reinterpret_cast<uint8_t *>(words), count);
+    }
+}
+
+// count words into bytes (2 * count of them) in order.
+inline void encode_words(const uint16_t *words, size_t count, ByteOrder order, uint8_t *bytes)
+{
+    if (order == NATIVE_ORDER)
+    {
+        std::memcpy(bytes, words, 2 * count);
+    }
+    else
+    {
+        swap_word_bytes(reinterpret_cast<const uint8_t *>(words), bytes, count);
+    }
+}
+
+namespace image_detail
+{
+// The count (up to 8) bytes at bytes as a little-endian number.
+inline uint64_t chunk_at(const uint8_t *bytes, size_t count)
+{
+    uint64_t chunk = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        chunk |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+    }
+    return chunk;
+}
+
+inline uint64_t chunk_at(const uint8_t *bytes)
+{
+    if constexpr (NATIVE_ORDER == ByteOrder::LITTLE)
+    {
+        uint64_t chunk;
+        std::memcpy(&chunk, bytes, 8);
+        return chunk;
+    }
+    return chunk_at(bytes, 8);
+}
+
+// FNV-1a with 64-bit steps over the bytes as little-endian 8-byte chunks (the last one padded
+// with zeros), chunk i going to lane i % 8 so that the multiplies overlap; the lanes are then
+// hashed together and folded to 32 bits. A 128K image takes microseconds, not the hundreds a
+// byte at a time would.
+inline uint32_t checksum(const uint8_t *bytes, size_t length)
+{
+    constexpr uint64_t BASIS = 14695981039346656037ull;
+    constexpr uint64_t PRIME = 1099511628211ull;
+    uint64_t lanes[8] = {BASIS, BASIS, BASIS, BASIS, BASIS, BASIS, BASIS, BASIS};
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64)
+    {
+        for (int lane = 0; lane < 8; ++lane)
+        {
+            lanes[lane] = (lanes[lane] ^ chunk_at(bytes + i + 8 * lane)) * PRIME;
+        }
+    }
+    for (int lane = 0; i < length; ++lane, i += 8)
+    {
+        lanes[lane] = (lanes[lane] ^ chunk_at(bytes + i, std::min<size_t>(8, length - i))) * PRIME;
+    }
+    uint64_t hash = BASIS;
+    for (uint64_t lane : lanes)
+    {
+        hash = (hash ^ lane) * PRIME;
+    }
+    return static_cast<uint32_t>(hash ^ hash >> 32);
+}
+
+inline uint32_t get(const uint8_t *bytes, int count)
+{
+    uint32_t value = 0;
+    for (int i = count - 1; i >= 0; --i)
+    {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+inline void put(std::string &bytes, uint32_t value, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        bytes.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+inline int hex_digit(char c)
+{
+    return c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// Appends an Intel HEX record: the colon, then count, address, type, data and checksum in hex.
+inline void put_record(std::string &text, uint8_t type, uint16_t address, const uint8_t *data, size_t count)
+{
+    static const char DIGITS[] = "0123456789ABCDEF";
+    uint8_t record[4 + 255 + 1] = {static_cast<uint8_t>(count), static_cast<uint8_t>(address >> 8),
+                                   static_cast<uint8_t>(address), type};
+    if (count > 0)
+    {
+        std::memcpy(record + 4, data, count);
+    }
+    uint8_t sum = 0;
+    for (size_t i = 0; i < 4 + count; ++i)
+    {
+        sum += record[i];
+    }
+    record[4 + count] = static_cast<uint8_t>(-sum);
+    text.push_back(':');
+    for (size_t i = 0; i < 5 + count; ++i)
+    {
+        text.push_back(DIGITS[record[i] >> 4]);
+        text.push_back(DIGITS[record[i] & 15]);
+    }
+    text.push_back('\n');
+}
+} // namespace image_detail
+
+// Checks a raw image's or a container's bytes and copies the words into memory (MEMORY_WORDS
+// of them), leaving memory as it was when they are rejected. A raw image's words are in order.
+inline bool parse_image(const uint8_t *bytes, size_t length, uint16_t *memory, ImageInfo &info, std::string &error,
+                        ByteOrder order = ByteOrder::LITTLE)
+{
+    using image_detail::get;
+    info = ImageInfo();
+    if (length < sizeof(IMAGE_MAGIC) || std::memcmp(bytes, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0)
+    {
+        if (length == 0 || length % 2 != 0 || length > MEMORY_WORDS * 2)
+        {
+            error = "a raw image must be 1 to 65536 whole words, not " + std::to_string(length) + " bytes";
+            return false;
+        }
+        info.words = static_cast<uint32_t>(length / 2);
+        decode_words(bytes, info.words, order, memory);
+        return true;
+    }
+
+    if (length < IMAGE_HEADER_BYTES)
+    {
+        error = "the header is cut short";
+        return false;
+    }
+    uint16_t version = get(bytes + 8, 2);
+    uint16_t flags = get(bytes + 10, 2);
+    info.container = true;
+    info.load_address = get(bytes + 12, 2);
+    info.entry = get(bytes + 14, 2);
+    info.words = get(bytes + 16, 4);
+    uint32_t checksum = get(bytes + 20, 4);
+    uint32_t symbol_bytes = get(bytes + 24, 4);
+    if (version != IMAGE_VERSION)
+    {
+        error = "version " + std::to_string(version) + " images are not supported";
+        return false;
+    }
+    if ((flags & ~IMAGE_SYMBOLS) != 0 || get(bytes + 28, 4) != 0 || ((flags & IMAGE_SYMBOLS) == 0) != (symbol_bytes == 0))
+    {
+        error = "unknown flags or reserved fields";
+        return false;
+    }
+    if (info.words == 0 || info.words > MEMORY_WORDS - info.load_address)
+    {
+        error = std::to_string(info.words) + " words do not fit at the load address";
+        return false;
+    }
+    if (length != IMAGE_HEADER_BYTES + 2 * static_cast<uint64_t>(info.words) + symbol_bytes)
+    {
+        error = "the file is " + std::to_string(length) + " bytes, the header says " +
+                std::to_string(IMAGE_HEADER_BYTES + 2 * static_cast<uint64_t>(info.words) + symbol_bytes);
+        return false;
+    }
+    const uint8_t *words = bytes + IMAGE_HEADER_BYTES;
+    if (image_detail::checksum(words, 2 * info.words) != checksum)
+    {
+        error = "the checksum does not match";
+        return false;
+    }
+    decode_words(words, info.words, ByteOrder::LITTLE, memory + info.load_address);
+    info.symbols.assign(reinterpret_cast<const char *>(words + 2 * info.words), symbol_bytes);
+    return true;
+}
+
+// Reads Intel HEX records (data, end of file, extended segment and linear addresses; start
+// addresses are skipped) into memory, each word's bytes in order. info covers the lowest to
+// the highest word written. Memory is left as it was when a record is bad or the end record
+// is missing.
+inline bool parse_intel_hex(std::string_view text, uint16_t *memory, ImageInfo &info, std::string &error,
+                            ByteOrder order = ByteOrder::LITTLE)
+{
+    info = ImageInfo();
+    std::vector<uint16_t> staged(memory, memory + MEMORY_WORDS);
+    uint32_t base = 0;
+    uint32_t lowest = UINT32_MAX;
+    uint32_t highest = 0;
+    size_t line = 0;
+    for (size_t start = 0; start < text.size();)
+    {
+        size_t end = std::min(text.find('\n', start), text.size());
+        std::string_view record = text.substr(start, end - start);
+        start = end + 1;
+        line++;
+        if (!record.empty() && record.back() == '\r')
+        {
+            record.remove_suffix(1);
+        }
+        if (record.empty())
+        {
+            continue;
+        }
+        uint8_t bytes[4 + 255 + 1];
+        size_t count = (record.size() - 1) / 2;
+        bool valid = record[0] == ':' && record.size() % 2 == 1 && count >= 5 && count <= sizeof(bytes);
+        uint8_t sum = 0;
+        for (size_t i = 0; valid && i < count; ++i)
+        {
+            int high = image_detail::hex_digit(record[1 + 2 * i]);
+            int low = image_detail::hex_digit(record[2 + 2 * i]);
+            valid = high >= 0 && low >= 0;
+            bytes[i] = static_cast<uint8_t>(high << 4 | low);
+            sum += bytes[i];
+        }
+        if (!valid || count != 5u + bytes[0] || sum != 0)
+        {
+            error = "line " + std::to_string(line) + " is not a valid record";
+            return false;
+        }
+        uint8_t type = bytes[3];
+        const uint8_t *data = bytes + 4;
+        if (type == 0x00)
+        {
+            for (uint32_t i = 0; i < bytes[0]; ++i)
+            {
+                uint32_t address = base + (bytes[1] << 8 | bytes[2]) + i;
+                if (address >= 2 * MEMORY_WORDS)
+                {
+                    error = "line " + std::to_string(line) + " writes past the end of memory";
+                    return false;
+                }
+                int shift = ((address & 1) != 0) == (order == ByteOrder::LITTLE) ? 8 : 0;
+                uint16_t &word = staged[address / 2];
+                word = static_cast<uint16_t>((word & ~(0xFF << shift)) | data[i] << shift);
+                lowest = std::min(lowest, address / 2);
+                highest = std::max(highest, address / 2);
+            }
+        }
+        else if (type == 0x01)
+        {
+            if (lowest > highest)
+            {
+                error = "the file has no data";
+                return false;
+            }
+            std::copy(staged.begin() + lowest, staged.begin() + highest + 1, memory + lowest);
+            info.load_address = static_cast<uint16_t>(lowest);
+            info.words = highest - lowest + 1;
+            return true;
+        }
+        else if ((type == 0x02 || type == 0x04) && bytes[0] == 2)
+        {
+            base = static_cast<uint32_t>(data[0] << 8 | data[1]) << (type == 0x02 ? 4 : 16);
+        }
+        else if ((type != 0x03 && type != 0x05) || bytes[0] != 4)
+        {
+            error = "line " + std::to_string(line) + " has an unknown record type";
+            return false;
+        }
+    }
+    error = "the end of file record is missing";
+    return false;
+}
+
+// Loads the image at path into memory (MEMORY_WORDS words; the rest is left as it is): Intel
+// HEX when the name ends in .hex, a raw image or a container otherwise. order is the byte
+// order of raw and Intel HEX words; containers are little-endian.
+inline bool read_image(const std::string &path, uint16_t *memory, ImageInfo &info, std::string &error,
+                       ByteOrder order = ByteOrder::LITTLE)
+{
+    bool hex = path.size() > 4 && path.compare(path.size() - 4, 4, ".hex") == 0;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "cannot open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode))
+    {
+        error = path + " is not a file";
+        close(fd);
+        return false;
+    }
+    size_t length = static_cast<size_t>(status.st_size);
+    if (length == 0)
+    {
+        close(fd);
+        return hex ? parse_intel_hex("", memory, info, error, order) : parse_image(nullptr, 0, memory, info, error, order);
+    }
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    void *mapped = mmap(nullptr, length, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        error = "cannot map " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    bool loaded = hex ? parse_intel_hex(std::string_view(static_cast<const char *>(mapped), length), memory, info,
+                                        error, order)
+                      : parse_image(static_cast<const uint8_t *>(mapped), length, memory, info, error, order);
+    munmap(mapped, length);
+    return loaded;
+}
+
+// A raw image of count words, in order.
+inline std::string raw_image(const uint16_t *words, size_t count, ByteOrder order = ByteOrder::LITTLE)
+{
+    std::string bytes(2 * count, '\0');
+    encode_words(words, count, order, reinterpret_cast<uint8_t *>(bytes.data()));
+    return bytes;
+}
+
+// count words that belong at load_address as Intel HEX, 16 bytes a record, each word's bytes
+// in order.
+inline std::string intel_hex(const uint16_t *words, size_t count, uint16_t load_address,
+                             ByteOrder order = ByteOrder::LITTLE)
+{
+    std::string bytes = raw_image(words, count, order);
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(bytes.data());
+    std::string text;
+    text.reserve(bytes.size() / 16 * 44 + 64);
+    uint32_t segment = 0;
+    for (size_t offset = 0; offset < bytes.size();)
+    {
+        uint32_t address = 2u * load_address + static_cast<uint32_t>(offset);
+        if (address >> 16 != segment)
+        {
+            segment = address >> 16;
+            const uint8_t upper[2] = {static_cast<uint8_t>(segment >> 8), static_cast<uint8_t>(segment)};
+            image_detail::put_record(text, 0x04, 0, upper, 2);
+        }
+        // a record never runs into the next 64K, whose addresses need a new 0x04 record
+        size_t length = std::min<size_t>({16, bytes.size() - offset, 0x10000 - (address & 0xFFFF)});
+        image_detail::put_record(text, 0x00, static_cast<uint16_t>(address), data + offset, length);
+        offset += length;
+    }
+    image_detail::put_record(text, 0x01, 0, nullptr, 0);
+    return text;
+}
+
+// A container holding words at load_address, starting at entry, with symbols (table.txt
+// text, or empty for none).
+inline std::string container_image(const std::vector<uint16_t> &words, uint16_t load_address, uint16_t entry,
+                                   const std::string &symbols)
+{
+    using image_detail::put;
+    std::string data = raw_image(words.data(), words.size());
+    std::string bytes(IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    put(bytes, IMAGE_VERSION, 2);
+    put(bytes, symbols.empty() ? 0 : IMAGE_SYMBOLS, 2);
+    put(bytes, load_address, 2);
+    put(bytes, entry, 2);
+    put(bytes, static_cast<uint32_t>(words.size()), 4);
+    put(bytes, image_detail::checksum(reinterpret_cast<const uint8_t *>(data.data()), data.size()), 4);
+    put(bytes, static_cast<uint32_t>(symbols.size()), 4);
+    put(bytes, 0, 4);
+    return bytes + data + symbols;
+}
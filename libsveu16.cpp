@@ -0,0 +1,224 @@
+#include "libsveu16.h"
+#include "native.h"
+
+#include <algorithm>
+
+namespace sveu16
+{
+namespace
+{
+constexpr uint16_t DATA_STACK_BASE = 0xAEB0;   // ESPP
+constexpr uint16_t RETURN_STACK_BASE = 0xAE70; // ERP
+// call() sets IP here and keeps this cell pointing at itself: NEXT1 after the called word
+// then jumps to it, where run_until() stops. Between MEME ($AF00) and the framebuffer,
+// memory eForth never uses.
+constexpr uint16_t CALL_RETURN = 0xAFFF;
+
+std::span<uint16_t> stack(Memory &memory, uint16_t pointer, uint16_t base)
+{
+    return pointer <= base ? std::span<uint16_t>(&memory[pointer], base - pointer) : std::span<uint16_t>();
+}
+} // namespace
+
+struct Vm::Impl
+{
+    Machine machine;
+    uint16_t context = 0; // CONTEXT's code field, looked up again when it no longer is
+};
+
+Vm::Vm() : impl(new Impl)
+{
+    impl->machine.skip_idle = true;
+}
+Vm::~Vm() = default;
+Vm::Vm(Vm &&) noexcept = default;
+Vm &Vm::operator=(Vm &&) noexcept = default;
+
+bool Vm::load(const std::string &path)
+{
+    impl->machine.clear();
+    impl->context = 0;
+    return impl->machine.load_memory(path);
+}
+
+void Vm::load(const uint16_t *words, size_t count)
+{
+    impl->machine.clear();
+    impl->context = 0;
+    Memory &memory = impl->machine.memory;
+    std::copy(words, words + std::min(count, memory.size()), memory.begin());
+}
+
+bool Vm::install_native(const std::string &symbols_path)
+{
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols(symbols_path);
+    if (!install_drawchar_hooks(impl->machine, symbols))
+    {
+        return false;
+    }
+    install_native_words(impl->machine, symbols, native_words());
+    return true;
+}
+
+uint64_t Vm::run(uint64_t cycles)
+{
+    uint64_t start = impl->machine.cycles;
+    impl->machine.run(cycles);
+    return impl->machine.cycles - start;
+}
+
+bool Vm::run_until_idle(uint64_t budget)
+{
+    return ::run_until_idle(impl->machine, budget);
+}
+
+void Vm::type(const std::string &text)
+{
+    impl->machine.type(text);
+}
+
+std::string Vm::take_console()
+{
+    std::string text;
+    text.swap(impl->machine.console);
+    return text;
+}
+
+uint64_t Vm::cycles() const
+{
+    return impl->machine.cycles;
+}
+
+uint16_t Vm::reg(int index) const
+{
+    return impl->machine.registers[index & 15];
+}
+
+void Vm::set_reg(int index, uint16_t value)
+{
+    impl->machine.registers[index & 15] = value;
+}
+
+uint16_t Vm::peek(uint16_t address) const
+{
+    return impl->machine.memory[address];
+}
+
+void Vm::poke(uint16_t address, uint16_t value)
+{
+    impl->machine.memory[address] = value;
+    impl->machine.stored(address);
+}
+
+std::span<uint16_t> Vm::memory()
+{
+    return impl->machine.memory;
+}
+
+std::span<const uint16_t> Vm::memory() const
+{
+    return impl->machine.memory;
+}
+
+std::span<uint16_t> Vm::data_stack()
+{
+    return stack(impl->machine.memory, impl->machine.registers[2], DATA_STACK_BASE);
+}
+
+std::span<uint16_t> Vm::return_stack()
+{
+    return stack(impl->machine.memory, impl->machine.registers[3], RETURN_STACK_BASE);
+}
+
+void Vm::push(uint16_t value)
+{
+    Machine &machine = impl->machine;
+    machine.registers[2]--;
+    machine.memory[machine.registers[2]] = value;
+    machine.stored(machine.registers[2]);
+}
+
+uint16_t Vm::pop()
+{
+    Machine &machine = impl->machine;
+    return machine.memory[machine.registers[2]++];
+}
+
+// The wordlists in CONTEXT are searched in order, each from its head down the links, as
+// WID? does; a chain that loops or runs into the ports ends the search.
+uint16_t Vm::find(std::string_view name) const
+{
+    const Memory &memory = impl->machine.memory;
+    uint16_t &context = impl->context;
+    if (context < 9 || !header_name_is(memory, context - 9, "CONTEXT"))
+    {
+        uint16_t na = find_name(impl->machine, "CONTEXT");
+        if (na == 0)
+        {
+            return 0;
+        }
+        context = name_to_cfa(memory, na);
+    }
+
+    for (uint16_t cell = context + 2; cell < context + 2 + 64 && memory[cell] != 0; ++cell)
+    {
+        size_t links = 0;
+        for (uint16_t na = memory[memory[cell]]; na != 0 && links < 8192; na = memory[na - 1], ++links)
+        {
+            if (memory[na] > MAX_NAME_LENGTH || na + memory[na] + 2 >= KEYBOARD_PORT)
+            {
+                break;
+            }
+            if (header_name_is(memory, na, name))
+            {
+                return name_to_cfa(memory, na);
+            }
+        }
+    }
+    return 0;
+}
+
+bool Vm::call(uint16_t cfa, std::span<const uint16_t> args, std::span<uint16_t> results, size_t &count,
+              uint64_t budget)
+{
+    Machine &machine = impl->machine;
+    uint16_t saved[16];
+    std::copy(std::begin(machine.registers), std::end(machine.registers), saved);
+    uint16_t saved_return = machine.memory[CALL_RETURN];
+    for (uint16_t arg : args)
+    {
+        push(arg);
+    }
+    machine.memory[CALL_RETURN] = CALL_RETURN;
+    machine.registers[4] = CALL_RETURN;
+    machine.registers[5] = cfa;
+    machine.registers[PC] = machine.memory[cfa];
+
+    bool returned = machine.run_until(CALL_RETURN, budget);
+    uint16_t end = machine.registers[2];
+    uint16_t top = saved[2];
+    count = returned && end <= top ? top - end : 0;
+    for (size_t i = 0; i < std::min(count, results.size()); ++i)
+    {
+        results[i] = machine.memory[top - 1 - i];
+    }
+    std::copy(saved, saved + 16, machine.registers);
+    machine.memory[CALL_RETURN] = saved_return;
+    return returned && end <= top;
+}
+
+bool Vm::attach(uint16_t address, Device &device)
+{
+    return impl->machine.attach_device(address, device);
+}
+
+void Vm::detach(uint16_t address)
+{
+    impl->machine.detach_device(address);
+}
+
+Machine &Vm::machine()
+{
+    return impl->machine;
+}
+} // namespace sveu16
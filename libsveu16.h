@@ -0,0 +1,127 @@
+// libsveu16: SVEU16 machines embedded in a host program. Vm keeps its Machine behind a
+// pointer and this header needs only device.h and the standard library, so a host built
+// against one version of the library keeps working with the next (machine() aside, which
+// is the core itself for tools built on it). Every Vm is independent: the library has no
+// global state, and Vms can run on different threads at once.
+// Built static, or shared with BUILD_SHARED_LIBS (SVEU16_SHARED is then defined for hosts).
+#pragma once
+
+#include "device.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(SVEU16_SHARED) && defined(_WIN32)
+#ifdef SVEU16_BUILDING
+#define SVEU16_API __declspec(dllexport)
+#else
+#define SVEU16_API __declspec(dllimport)
+#endif
+#elif defined(SVEU16_SHARED)
+#define SVEU16_API __attribute__((visibility("default")))
+#else
+#define SVEU16_API
+#endif
+
+class Machine;
+
+namespace sveu16
+{
+class SVEU16_API Vm
+{
+public:
+    Vm();
+    ~Vm();
+    Vm(Vm &&) noexcept;
+    Vm &operator=(Vm &&) noexcept;
+
+    // Loads an image after returning the Vm to how it was built: memory zero and no native
+    // hooks, breakpoints, watchpoints, devices, keys or console output. The machine starts at
+    // address 0.
+    // The path overload takes any image Machine::load_memory does (image.h). That is a raw
+    // image as forth.mem is stored (little-endian words from address 0), a SVEU16IM container,
+    // or Intel HEX when the name ends in .hex. A container is loaded at its load address and
+    // starts at its entry point. A shorter image leaves the rest of memory zero. A file that is
+    // not a valid image returns false and leaves memory zero.
+    bool load(const std::string &path);
+    void load(const uint16_t *words, size_t count);
+
+    // The native hooks for DRAWCHAR, SCROLL and the kernel words sveu16 enables by default,
+    // found through a table.txt symbol table. Returns false when the image has no DRAWCHAR.
+    bool install_native(const std::string &symbols_path = "table.txt");
+
+    // Runs cycles cycles. Returns the cycles run, fewer when the machine stopped. Rounds of
+    // the loop eForth waits for a key in are counted rather than run (Machine::skip_idle),
+    // so a host pacing the guest in real time spends next to nothing while it waits.
+    uint64_t run(uint64_t cycles);
+    // Runs until eForth waits for a key, up to budget cycles. Returns false at the budget.
+    bool run_until_idle(uint64_t budget = 100000000);
+    void type(const std::string &text);
+    // What the guest wrote to the console port since the last call.
+    std::string take_console();
+
+    uint64_t cycles() const;
+    uint16_t reg(int index) const;
+    void set_reg(int index, uint16_t value);
+    uint16_t peek(uint16_t address) const;
+    void poke(uint16_t address, uint16_t value);
+
+    // Guest memory itself, 64K words. Stores through it are not seen by watchpoints or the
+    // native words' dictionary index: poke the dictionary instead.
+    std::span<uint16_t> memory();
+    std::span<const uint16_t> memory() const;
+    // The main task's stacks in place, top of stack first: the data stack from R2 up to
+    // ESPP ($AEB0), the return stack from R3 up to ERP ($AE70). Empty when the pointer is
+    // out of range.
+    std::span<uint16_t> data_stack();
+    std::span<uint16_t> return_stack();
+    void push(uint16_t value);
+    uint16_t pop();
+
+    // Code field address of the newest word called name in the CONTEXT search order, as
+    // eForth would find it (names are compared as stored), 0 when there is none.
+    uint16_t find(std::string_view name) const;
+    // Runs the word at cfa with args pushed on the data stack (the last on top), until it
+    // returns or budget cycles have run. Copies what it leaves in place of the arguments
+    // into results, deepest first, and sets count to how many there are; count may exceed
+    // results.size(). Every register is then as it was and the data stack has neither
+    // the arguments nor the results, so the guest can go on from where it was. Returns false
+    // when the word did not return, stopped at a breakpoint or watchpoint, or took more
+    // from the stack than args. Needs a booted image (run_until_idle() after load()).
+    bool call(uint16_t cfa, std::span<const uint16_t> args, std::span<uint16_t> results, size_t &count,
+              uint64_t budget = 10000000);
+
+    // call() by name: the results, or nothing when there is no such word, the call failed or
+    // it left more than 16.
+    template <typename... Args>
+    std::optional<std::vector<uint16_t>> call_word(std::string_view name, Args... args)
+    {
+        uint16_t cfa = find(name);
+        const uint16_t pushed[] = {static_cast<uint16_t>(args)..., 0};
+        uint16_t results[16];
+        size_t count = 0;
+        if (cfa == 0 || !call(cfa, std::span<const uint16_t>(pushed, sizeof...(Args)), results, count) ||
+            count > 16)
+        {
+            return std::nullopt;
+        }
+        return std::vector<uint16_t>(results, results + count);
+    }
+
+    // See Machine::attach_device. The Vm does not own device.
+    bool attach(uint16_t address, Device &device);
+    void detach(uint16_t address);
+
+    Machine &machine();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+} // namespace sveu16
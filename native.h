@@ -0,0 +1,928 @@
+// Native (host side) replacements for hot routines of the eForth kernel in forth.mem.
+// Every hook leaves registers, memory and the cycle counter exactly as the interpreted
+// guest code would; when it cannot guarantee that it returns false and the guest code runs.
+#pragma once
+
+#include "sveu16.h"
+#include "dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// DRAWCHAR .. DOCR from forth.asm as assembled. Words holding an address are listed in
+// DRAWCHAR_RELOCATIONS: 'r' = label inside the routine (stored relative to DRAWCHAR),
+// 'x' = XVAL, 'y' = YVAL, 'f' = FONT (stored as 0).
+const uint16_t DRAWCHAR_CODE[] = {
+    0x2331, 0x8443, 0x2331, 0x8223, 0x2331, 0x8993, 0x2331, 0x8BB3, 0x2331, 0x8CC3, 0x2000, 0x044F,
+    0x0008, 0x0BBF, 0x00A4, 0xE745, 0x9F7B, 0x044F, 0x000A, 0x0BBF, 0x007F, 0xE745, 0x9F7B, 0x044F,
+    0x000D, 0x0BBF, 0x00B9, 0xE745, 0x9F7B, 0x088F, 0x0000, 0x0778, 0x088F, 0x0000, 0x0888, 0x022F,
+    0x0140, 0x7882, 0x3B71, 0x6771, 0x1887, 0x1555, 0x1555, 0x066F, 0x0000, 0x1556, 0x066F, 0xB000,
+    0x1668, 0x088F, 0x00FF, 0x099F, 0xFF00, 0x077F, 0x0028, 0x0CCF, 0x0038, 0x000F, 0x0005, 0x022F,
+    0x0053, 0x9FB2, 0x4BFF, 0x0225, 0x0446, 0x3448, 0x3A29, 0x444A, 0x8446, 0x622C, 0x1667, 0x0446,
+    0x3448, 0x3A29, 0x444A, 0x8446, 0x1667, 0x1551, 0x2001, 0xA201, 0x9F2B, 0x0FFF, 0x0066, 0x4BFF,
+    0x0225, 0x0446, 0x3449, 0x3A29, 0x6AAC, 0x444A, 0x8446, 0x1667, 0x0446, 0x3449, 0x3A28, 0x444A,
+    0x8446, 0x1667, 0x1551, 0x2001, 0xA201, 0x9F2B, 0x0CCF, 0x0000, 0x055C, 0x1551, 0x044F, 0x004F,
+    0x0BBF, 0x007D, 0xA654, 0x9F6B, 0x855C, 0x2000, 0x0CC3, 0x1331, 0x0BB3, 0x1331, 0x0993, 0x1331,
+    0x0223, 0x1331, 0x0443, 0x1331, 0x4FBB, 0x2000, 0x800C, 0x0CCF, 0x0000, 0x055C, 0x1551, 0x855C,
+    0x044F, 0x003C, 0x0BBF, 0x0071, 0xC754, 0x9F7B, 0x2441, 0x844C, 0x044F, 0xB000, 0x066F, 0xB140,
+    0x088F, 0x49C0, 0xFBFF, 0x0556, 0x8554, 0x1441, 0x1661, 0x2881, 0xA780, 0x9F7B, 0x088F, 0x0140,
+    0xFBFF, 0x8004, 0x1441, 0x2881, 0xA780, 0x9F7B, 0x0FBF, 0x0071, 0x0CCF, 0x0000, 0x088F, 0x0000,
+    0x066C, 0x0998, 0xA760, 0x044F, 0x00B3, 0x9F74, 0x066F, 0x0050, 0xEA90, 0x1FFA, 0x2991, 0x2661,
+    0x8998, 0x866C, 0x0BBF, 0x0071, 0x4FBB, 0x0CCF, 0x0000, 0x800C, 0x0BBF, 0x0071, 0x4FBB,
+};
+
+struct Relocation
+{
+    uint16_t offset;
+    char kind;
+};
+
+const Relocation DRAWCHAR_RELOCATIONS[] = {
+    {14, 'r'}, {20, 'r'}, {26, 'r'}, {30, 'x'}, {33, 'y'}, {44, 'f'}, {60, 'r'}, {82, 'r'}, {103, 'x'}, {109, 'r'},
+    {128, 'y'}, {135, 'r'}, {163, 'r'}, {165, 'x'}, {167, 'y'}, {172, 'r'}, {183, 'r'}, {186, 'x'}, {189, 'r'},
+};
+
+// Offsets of the labels inside DRAWCHAR that show up in guest registers.
+constexpr uint16_t EXITCHAR_OFFSET = 113;
+constexpr uint16_t SCROLL_OFFSET = 140;
+constexpr uint16_t EMPTYLASTLP_OFFSET = 157;
+constexpr uint16_t BS1_OFFSET = 179;
+
+// Cycles the interpreted SCROLL takes: 18880 words moved at 7 instructions each, 320
+// words cleared at 5 each, plus setup.
+constexpr uint64_t SCROLL_CYCLES = 4 + 18880 * 7 + 2 + 320 * 5 + 1;
+
+struct DrawcharLayout
+{
+    uint16_t entry = 0; // DRAWCHAR
+    uint16_t xval = 0;
+    uint16_t yval = 0;
+    uint16_t font = 0;
+};
+
+// Checks that the code at entry is DRAWCHAR and reads XVAL, YVAL and FONT out of it.
+inline bool match_drawchar(const Machine &machine, uint16_t entry, DrawcharLayout &layout)
+{
+    const size_t length = sizeof(DRAWCHAR_CODE) / sizeof(DRAWCHAR_CODE[0]);
+    if (entry + length > machine.memory.size())
+    {
+        return false;
+    }
+
+    const uint16_t *code = &machine.memory[entry];
+    uint16_t found[3] = {0, 0, 0}; // x, y, f
+    bool seen[3] = {false, false, false};
+    for (size_t i = 0; i < length; ++i)
+    {
+        const Relocation *relocation = nullptr;
+        for (const Relocation &r : DRAWCHAR_RELOCATIONS)
+        {
+            if (r.offset == i)
+            {
+                relocation = &r;
+                break;
+            }
+        }
+
+        if (relocation == nullptr)
+        {
+            if (code[i] != DRAWCHAR_CODE[i])
+            {
+                return false;
+            }
+        }
+        else if (relocation->kind == 'r')
+        {
+            if (code[i] != static_cast<uint16_t>(entry + DRAWCHAR_CODE[i]))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            int slot = relocation->kind == 'x' ? 0 : relocation->kind == 'y' ? 1 : 2;
+            if (seen[slot] && found[slot] != code[i])
+            {
+                return false;
+            }
+            found[slot] = code[i];
+            seen[slot] = true;
+        }
+    }
+
+    layout.entry = entry;
+    layout.xval = found[0];
+    layout.yval = found[1];
+    layout.font = found[2];
+    return true;
+}
+
+// Finds DRAWCHAR through the symbol table, or by searching the image when the table does
+// not describe it (table.txt is not regenerated together with forth.mem).
+inline bool find_drawchar(const Machine &machine, const std::unordered_map<std::string, uint16_t> &symbols,
+                          DrawcharLayout &layout)
+{
+    auto it = symbols.find("DRAWCHAR");
+    if (it != symbols.end() && match_drawchar(machine, it->second, layout))
+    {
+        return true;
+    }
+    for (uint32_t address = 0; address < machine.memory.size(); ++address)
+    {
+        if (machine.memory[address] == DRAWCHAR_CODE[0] && match_drawchar(machine, address, layout))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// SCROLL: move the framebuffer up one character row (8 pixel rows = 320 words) and clear
+// the last one, then continue at EXITCHAR with the registers the loops leave behind.
+inline uint64_t native_scroll(Machine &machine, const DrawcharLayout &layout)
+{
+    uint16_t *r = machine.registers;
+    uint16_t *video = &machine.memory[VIDEO_MEMORY_START];
+    r[5] = video[VIDEO_MEMORY_WORDS - 1]; // last word the copy loop loads
+    std::memmove(video, video + 320, (VIDEO_MEMORY_WORDS - 320) * sizeof(uint16_t));
+    std::memset(video + VIDEO_MEMORY_WORDS - 320, 0, 320 * sizeof(uint16_t));
+    machine.stored(VIDEO_MEMORY_START, VIDEO_MEMORY_WORDS);
+    r[4] = VIDEO_MEMORY_START + VIDEO_MEMORY_WORDS;
+    r[6] = VIDEO_MEMORY_START + VIDEO_MEMORY_WORDS;
+    r[7] = 0;
+    r[8] = 0;
+    r[11] = layout.entry + EMPTYLASTLP_OFFSET;
+    r[PC] = layout.entry + EXITCHAR_OFFSET;
+    return SCROLL_CYCLES;
+}
+
+// The whole DRAWCHAR call, from entry to the jump back through R11. Only taken for the
+// normal case: R1 = 1, cursor on screen and the saved registers out of the way of
+// everything the routine writes.
+inline bool native_drawchar(Machine &machine, const DrawcharLayout &layout)
+{
+    uint16_t *r = machine.registers;
+    uint16_t x = machine.memory[layout.xval];
+    uint16_t y = machine.memory[layout.yval];
+    auto saved_over = [&](uint16_t address, uint16_t length)
+    { return address < r[3] && address + length > r[3] - 5; };
+    if (r[1] != 1 || x > 79 || y > 59 || r[3] < 5 || r[3] > VIDEO_MEMORY_START || saved_over(layout.xval, 1) ||
+        saved_over(layout.yval, 1) || saved_over(layout.entry, sizeof(DRAWCHAR_CODE) / sizeof(DRAWCHAR_CODE[0])))
+    {
+        return false;
+    }
+
+    const uint16_t saved[5] = {r[4], r[2], r[9], r[11], r[12]};
+    for (uint16_t value : saved)
+    {
+        r[3]--;
+        machine.write(r[3], value);
+    }
+    r[0] = 0;
+    uint64_t cycles = 11;
+
+    uint16_t ch = r[5];
+    bool line_feed = false;
+    r[4] = 8;
+    r[11] = layout.entry + DRAWCHAR_CODE[14];
+    r[7] = ch == 8;
+    cycles += 4;
+    if (ch == 8)
+    {
+        // DOBS: step back, wrapping to the end of the previous line
+        r[12] = layout.xval;
+        r[8] = layout.yval;
+        r[6] = x;
+        r[9] = y;
+        r[7] = x > 0;
+        r[4] = layout.entry + BS1_OFFSET;
+        cycles += 7;
+        if (x == 0)
+        {
+            r[6] = 80;
+            r[10] = y == 0;
+            cycles += 3;
+            if (y != 0)
+            {
+                r[9]--;
+                cycles++;
+            }
+        }
+        r[6]--;
+        machine.write(layout.yval, r[9]);
+        machine.write(layout.xval, r[6]);
+        r[11] = layout.entry + EXITCHAR_OFFSET;
+        cycles += 5;
+    }
+    else
+    {
+        r[4] = 10;
+        r[11] = layout.entry + DRAWCHAR_CODE[20];
+        r[7] = ch == 10;
+        cycles += 4;
+        if (ch == 10)
+        {
+            line_feed = true;
+        }
+        else
+        {
+            r[4] = 13;
+            r[11] = layout.entry + DRAWCHAR_CODE[26];
+            r[7] = ch == 13;
+            cycles += 4;
+            if (ch == 13)
+            {
+                // DOCR
+                r[12] = layout.xval;
+                machine.write(layout.xval, 0);
+                r[11] = layout.entry + EXITCHAR_OFFSET;
+                cycles += 4;
+            }
+            else
+            {
+                // PRINTABLECH: OR the 8x8 glyph into the left or right byte of 8 video words
+                uint16_t glyph = layout.font + 4 * ch;
+                uint16_t video = VIDEO_MEMORY_START + y * 320 + (x >> 1);
+                bool right = x & 1;
+                uint16_t keep = right ? 0xFF00 : 0x00FF;
+                uint16_t row_bits = 0;
+                uint16_t last_stored = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    row_bits = machine.read(static_cast<uint16_t>(glyph + i));
+                    uint16_t first = row_bits & 0xFF00;
+                    uint16_t second = Machine::shift(row_bits, 0x38) & 0xFF00;
+                    if (right)
+                    {
+                        first >>= 8;
+                        second = row_bits & 0x00FF;
+                    }
+                    uint16_t &top = machine.memory[video + 80 * i];
+                    top = (top & keep) | first;
+                    uint16_t &bottom = machine.memory[video + 80 * i + 40];
+                    bottom = (bottom & keep) | second;
+                    machine.stored(video + 80 * i);
+                    machine.stored(video + 80 * i + 40);
+                    last_stored = bottom;
+                }
+
+                r[0] = 1;
+                r[2] = 0;
+                r[4] = last_stored;
+                r[5] = glyph + 4;
+                r[6] = video + 320;
+                r[7] = 40;
+                r[8] = 0x00FF;
+                r[9] = 0xFF00;
+                r[10] = right ? (row_bits & 0x00FF) : (Machine::shift(row_bits, 0x38) & 0xFF00);
+                cycles += 22 + (right ? 73 : 74);
+
+                // NEXTCOL
+                r[12] = layout.xval;
+                r[5] = machine.memory[layout.xval] + 1;
+                r[4] = 79;
+                r[11] = layout.entry + DRAWCHAR_CODE[109];
+                r[6] = r[5] > 79;
+                cycles += 7;
+                if (r[5] > 79)
+                {
+                    r[0] = 0;
+                    machine.write(layout.xval, 0);
+                    cycles += 2;
+                    line_feed = true;
+                }
+                else
+                {
+                    machine.write(layout.xval, r[5]);
+                    cycles++;
+                }
+            }
+        }
+    }
+
+    if (line_feed)
+    {
+        r[12] = layout.yval;
+        r[5] = machine.memory[layout.yval] + 1;
+        machine.write(layout.yval, r[5]);
+        r[4] = 60;
+        r[11] = layout.entry + EXITCHAR_OFFSET;
+        r[7] = r[5] < 60;
+        cycles += 8;
+        if (r[5] >= 60)
+        {
+            r[4] = 59;
+            machine.write(layout.yval, 59);
+            cycles += 2 + native_scroll(machine, layout);
+        }
+    }
+
+    // EXITCHAR
+    r[0] = 0;
+    r[12] = machine.read(r[3]++);
+    r[11] = machine.read(r[3]++);
+    r[9] = machine.read(r[3]++);
+    r[2] = machine.read(r[3]++);
+    r[4] = machine.read(r[3]++);
+    r[PC] = r[11];
+    cycles += 12;
+
+    machine.cycles += cycles;
+    return true;
+}
+
+// Installs the DRAWCHAR hook and the SCROLL hook (for when SCROLL is reached by
+// interpreting DRAWCHAR). Returns false if the image has no DRAWCHAR this code knows.
+inline bool install_drawchar_hooks(Machine &machine, const std::unordered_map<std::string, uint16_t> &symbols,
+                                   bool drawchar = true, bool scroll = true)
+{
+    DrawcharLayout layout;
+    if (!find_drawchar(machine, symbols, layout))
+    {
+        return false;
+    }
+    if (drawchar)
+    {
+        machine.install_hook(layout.entry, [layout](Machine &m)
+                             { return native_drawchar(m, layout); });
+    }
+    if (scroll)
+    {
+        machine.install_hook(layout.entry + SCROLL_OFFSET, [layout](Machine &m)
+                             {
+                                 m.cycles += native_scroll(m, layout);
+                                 return true; });
+    }
+    return true;
+}
+
+// MOVE ( src dest len -- ) and FILL ( addr count value -- ) as assembled; neither holds an
+// absolute address. The kernel has no CMOVE or CMOVE>: MOVE picks the copy direction itself.
+const uint16_t MOVE_CODE[] = {
+    0x0552, 0x1221, 0x0662, 0x1221, 0x0772, 0x1221, 0xC867, 0x2B51, 0x9B80, 0x166B, 0x177B, 0x2B01,
+    0x9B81, 0x4CFF, 0xA850, 0x1FF8, 0x4F99, 0x0887, 0x8886, 0x166B, 0x177B, 0x2551, 0x4FCC,
+};
+const uint16_t FILL_CODE[] = {
+    0x0552, 0x1221, 0x0662, 0x1221, 0x0772, 0x1221, 0x4CFF, 0xA860, 0x1FF8, 0x4F99, 0x8557, 0x1771,
+    0x2661, 0x4FCC,
+};
+
+// Offsets of the loop heads (MOVE2, FILL2), left in R12.
+constexpr uint16_t MOVE_LOOP_OFFSET = 14;
+constexpr uint16_t FILL_LOOP_OFFSET = 7;
+
+// True when [start, start + length) stays below the device ports without wrapping, and so
+// can be read and written as plain memory.
+inline bool plain_memory(uint32_t start, uint32_t length)
+{
+    return start + length <= KEYBOARD_PORT;
+}
+
+inline bool overlaps(uint32_t a, uint32_t a_length, uint32_t b, uint32_t b_length)
+{
+    return a < b + b_length && b < a + a_length;
+}
+
+// MOVE: copies len words upwards when dest < src and downwards otherwise, which is what
+// memmove does for any overlap.
+inline bool native_move(Machine &machine, uint16_t code)
+{
+    uint16_t *r = machine.registers;
+    uint16_t length = machine.memory[r[2]];
+    uint16_t dest = machine.memory[static_cast<uint16_t>(r[2] + 1)];
+    uint16_t src = machine.memory[static_cast<uint16_t>(r[2] + 2)];
+    const uint16_t code_length = sizeof(MOVE_CODE) / sizeof(MOVE_CODE[0]);
+    if (r[0] != 0 || r[1] != 1 || !plain_memory(r[2], 3) || !plain_memory(dest, length) ||
+        !plain_memory(src, length) || overlaps(dest, length, code, code_length))
+    {
+        return false;
+    }
+
+    bool up = dest < src;
+    std::memmove(&machine.memory[dest], &machine.memory[src], length * sizeof(uint16_t));
+    machine.stored(dest, length);
+    r[2] += 3;
+    r[5] = 0;
+    r[6] = up ? dest + length : dest - 1;
+    r[7] = up ? src + length : src - 1;
+    r[8] = 0;
+    r[11] = up ? 1 : 0xFFFF;
+    r[12] = code + MOVE_LOOP_OFFSET;
+    r[PC] = r[9];
+    machine.cycles += 14 + 8 * static_cast<uint64_t>(length) + 3;
+    return true;
+}
+
+// FILL: stores value into count words from addr upwards.
+inline bool native_fill(Machine &machine, uint16_t code)
+{
+    uint16_t *r = machine.registers;
+    uint16_t value = machine.memory[r[2]];
+    uint16_t count = machine.memory[static_cast<uint16_t>(r[2] + 1)];
+    uint16_t address = machine.memory[static_cast<uint16_t>(r[2] + 2)];
+    const uint16_t code_length = sizeof(FILL_CODE) / sizeof(FILL_CODE[0]);
+    if (r[0] != 0 || r[1] != 1 || !plain_memory(r[2], 3) || !plain_memory(address, count) ||
+        overlaps(address, count, code, code_length))
+    {
+        return false;
+    }
+
+    std::fill_n(&machine.memory[address], count, value);
+    machine.stored(address, count);
+    r[2] += 3;
+    r[5] = value;
+    r[6] = 0;
+    r[7] = address + count;
+    r[8] = 0;
+    r[12] = code + FILL_LOOP_OFFSET;
+    r[PC] = r[9];
+    machine.cycles += 7 + 6 * static_cast<uint64_t>(count) + 3;
+    return true;
+}
+
+// UM* ( u u -- ud ) and UM/MOD ( udl udh u -- ur uq ) as assembled. SM/REM, FM/MOD, /MOD,
+// MOD, / and the number formatting words (#, #S, .) reach the host arithmetic through them.
+const uint16_t UMSTAR_CODE[] = {
+    0x0552, 0x1221, 0x0662, 0x0BFF, 0x00FF, 0x0CFF, 0x0018, 0x375B, 0x386B, 0x655C, 0x666C,
+    0x7A56, 0x7558, 0x7676, 0x7778, 0x685C, 0x1AA8, 0x686C, 0x1AA8, 0x0CFF, 0x0028, 0x666C,
+    0x655C, 0x1776, 0xC876, 0x1AA8, 0x1775, 0xC875, 0x1AA8, 0x8772, 0x2221, 0x8AA2, 0x4F99,
+};
+const uint16_t UMMOD_CODE[] = {
+    0x0772, 0x1221, 0x0552, 0x1221, 0x0662, 0x0BBF, 0x0010, 0x4AFF, 0xD860, 0x1555, 0x1558, 0x1666,
+    0xC857, 0x1FF8, 0x2557, 0x5881, 0x1668, 0x2BB1, 0xA8B0, 0x9F8A, 0x8552, 0x2221, 0x8662, 0x4F99,
+};
+
+// Offset of UMMO1's loop head, left in R10.
+constexpr uint16_t UMMOD_LOOP_OFFSET = 8;
+
+// UM*: the 32 bit product, with the partial products the guest leaves in R5..R12.
+inline bool native_umstar(Machine &machine, uint16_t code)
+{
+    uint16_t *r = machine.registers;
+    const uint16_t code_length = sizeof(UMSTAR_CODE) / sizeof(UMSTAR_CODE[0]);
+    if (r[0] != 0 || r[1] != 1 || !plain_memory(r[2], 2) || overlaps(r[2], 2, code, code_length))
+    {
+        return false;
+    }
+
+    uint16_t a = machine.memory[r[2]];
+    uint16_t b = machine.memory[r[2] + 1];
+    uint32_t product = static_cast<uint32_t>(a) * b;
+    uint16_t ahbl = (a >> 8) * (b & 0xFF);
+    uint16_t bhal = (b >> 8) * (a & 0xFF);
+    uint16_t low = product & 0xFFFF;
+    r[2]++;
+    machine.memory[r[2]] = low;
+    r[2]--;
+    machine.memory[r[2]] = product >> 16;
+    machine.stored(r[2], 2);
+    r[5] = ahbl << 8;
+    r[6] = bhal << 8;
+    r[7] = low;
+    r[8] = low < r[5];
+    r[10] = product >> 16;
+    r[11] = 0x00FF;
+    r[12] = 0x0028;
+    r[PC] = r[9];
+    machine.cycles += 30;
+    return true;
+}
+
+// UM/MOD: the guest shifts the remainder left without keeping its top bit, so it only
+// divides correctly when udh < u <= $8000. Then the host divides; otherwise the 16 steps
+// are repeated here bit for bit. Each step costs 11 cycles, 12 when it subtracts.
+inline bool native_ummod(Machine &machine, uint16_t code)
+{
+    uint16_t *r = machine.registers;
+    const uint16_t code_length = sizeof(UMMOD_CODE) / sizeof(UMMOD_CODE[0]);
+    if (r[0] != 0 || r[1] != 1 || !plain_memory(r[2], 3) || overlaps(r[2], 3, code, code_length))
+    {
+        return false;
+    }
+
+    uint16_t divisor = machine.memory[r[2]];
+    uint16_t high = machine.memory[r[2] + 1];
+    uint16_t low = machine.memory[r[2] + 2];
+    uint16_t remainder;
+    uint16_t quotient;
+    if (high < divisor && divisor <= 0x8000)
+    {
+        uint32_t dividend = static_cast<uint32_t>(high) << 16 | low;
+        remainder = dividend % divisor;
+        quotient = dividend / divisor;
+    }
+    else
+    {
+        remainder = high;
+        quotient = low;
+        for (int i = 0; i < 16; ++i)
+        {
+            remainder = remainder + remainder + (quotient >> 15);
+            quotient += quotient;
+            if (remainder >= divisor)
+            {
+                remainder -= divisor;
+                quotient++;
+            }
+        }
+    }
+
+    r[2] += 2;
+    machine.memory[r[2]] = remainder;
+    r[2]--;
+    machine.memory[r[2]] = quotient;
+    machine.stored(r[2], 2);
+    r[5] = remainder;
+    r[6] = quotient;
+    r[7] = divisor;
+    r[8] = 0;
+    r[10] = code + UMMOD_LOOP_OFFSET;
+    r[11] = 0;
+    r[PC] = r[9];
+    machine.cycles += 11 + 16 * 11 + __builtin_popcount(quotient);
+    return true;
+}
+
+// EXIT1, NEXT1 and LIST1, the colon word entry, as assembled. LIST1 is the code of every
+// colon word; EXIT1 falls through into NEXT1 right before it.
+const uint16_t EXIT_NEXT_CODE[] = {0x0443, 0x1331, 0x0554, 0x1441, 0x0FF5};
+const uint16_t LIST1_CODE[] = {0x2331, 0x8443, 0x1451, 0x0554, 0x1441, 0x0FF5};
+
+// SFIND ( a u -- xt lex -1 | a u 0 ) as compiled in forth.asm, for match_body.
+const std::vector<std::string> SFIND_BODY = {
+    "CONTEXT", "CELL-", ">R",  "R>", "CELL+", "DUP", ">R", "@",    "DUP", "_IF",
+    "+17",     "WID?",  "_IF", "+4", "_LIT",  "=FFFF", "R>", "DROP", "EXIT",
+};
+
+// SFIND: searches the wordlists in CONTEXT in order through the DictionaryIndex and returns
+// what WID? would have returned for the first wordlist that has the name. The data and
+// return stacks, IP and every cell SFIND leaves live are as the guest leaves them; cycles
+// (only the colon call and EXIT are charged), scratch registers and the dead cells below
+// the stack pointers are not, which is why SFIND is not enabled by default.
+inline bool native_sfind(Machine &machine, DictionaryIndex &index, uint16_t code)
+{
+    uint16_t *r = machine.registers;
+    const Memory &memory = machine.memory;
+    if (code < 5 || !std::equal(std::begin(EXIT_NEXT_CODE), std::end(EXIT_NEXT_CODE), &memory[code - 5]) ||
+        r[2] == 0 || !plain_memory(r[2] - 1, 3) || r[3] == 0 || !plain_memory(r[3] - 1, 1))
+    {
+        return false;
+    }
+
+    uint16_t length = memory[r[2]];
+    uint16_t address = memory[r[2] + 1];
+    std::u16string name;
+    if (length <= MAX_NAME_LENGTH)
+    {
+        if (!plain_memory(address, length))
+        {
+            return false;
+        }
+        name.assign(memory.begin() + address, memory.begin() + address + length);
+    }
+
+    uint16_t context = memory[r[5] + 1] + 2; // CONTEXT's _VAR data
+    uint16_t na = 0;
+    for (uint16_t cell = context; na == 0; ++cell)
+    {
+        if (!plain_memory(cell, 1) || cell - context > 64)
+        {
+            return false;
+        }
+        uint16_t wid = memory[cell];
+        if (wid == 0)
+        {
+            break;
+        }
+        if (!plain_memory(wid, 1) || !index.find(machine, wid, name, na))
+        {
+            return false;
+        }
+    }
+
+    machine.write(r[3] - 1, r[4]); // pushed by LIST1, popped by EXIT
+    r[2]--;
+    if (na == 0)
+    {
+        machine.write(r[2], 0);
+    }
+    else
+    {
+        machine.write(r[2], 0xFFFF);
+        machine.write(r[2] + 1, memory[na + length + 1]);
+        machine.write(r[2] + 2, na + length + 2);
+    }
+    r[PC] = code - 3;
+    machine.cycles += 5;
+    return true;
+}
+
+// PAUSE and the words it runs, as compiled in forth.asm: save SP and RP in TOS, jump through
+// FOLLOWER to the next task's STATUS, skip every task whose STATUS is _PASS, and let _WAKE
+// make the first awake task's user area current and restore its stacks.
+const std::vector<std::string> PAUSE_BODY = {"RP@", "SP@", "TOS", "!", "FOLLOWER", "@", ">R", "EXIT"};
+const std::vector<std::string> TOS_BODY = {"_USR", "=FFFE"};
+const std::vector<std::string> FOLLOWER_BODY = {"_USR", "=0"};
+const std::vector<std::string> USR_BODY = {"UP", "@", "R>", "@", "+", "EXIT"};
+const std::vector<std::string> UP_BODY = {"_VAR"};
+const std::vector<std::string> VAR_BODY = {"R>", "EXIT"};
+const std::vector<std::string> WAKE_BODY = {"R>", "UP", "!", "TOS", "@", "SP!", "RP!", "EXIT"};
+const std::vector<std::string> PASS_BODY = {"R>", "@", ">R", "EXIT"};
+
+struct PrimitiveCode
+{
+    const char *name;
+    std::vector<uint16_t> code;
+};
+
+const PrimitiveCode PAUSE_PRIMITIVES[] = {
+    {"RP@", {0x2221, 0x8332, 0x4F99}},
+    {"SP@", {0x4522, 0x2221, 0x8552, 0x4F99}},
+    {"!", {0x0552, 0x1221, 0x0662, 0x1221, 0x8665, 0x4F99}},
+    {"@", {0x0552, 0x0665, 0x8662, 0x4F99}},
+    {">R", {0x0552, 0x1221, 0x2331, 0x8553, 0x4F99}},
+    {"R>", {0x0553, 0x1331, 0x2221, 0x8552, 0x4F99}},
+    {"+", {0x0552, 0x1221, 0x0662, 0x1556, 0x8552, 0x4F99}},
+    {"SP!", {0x0222, 0x4F99}},
+    {"RP!", {0x0332, 0x1221, 0x4F99}},
+};
+
+// Cycles from entering PAUSE to NEXT1 in the task it wakes, and for every sleeping task
+// passed on the way.
+constexpr uint64_t PAUSE_CYCLES = 335;
+constexpr uint64_t PASS_CYCLES = 34;
+
+struct PauseLayout
+{
+    uint16_t tos = 0;
+    uint16_t usr = 0;
+    uint16_t up = 0;
+    uint16_t exit = 0;
+    uint16_t wake = 0; // _WAKE, the STATUS of an awake task
+    uint16_t pass = 0; // _PASS, the STATUS of a sleeping task
+};
+
+// Checks PAUSE and everything it runs down to the primitives, which all have to be the
+// kernel's own for the cycle counts above to hold.
+inline bool match_pause(const Machine &machine, uint16_t cfa, PauseLayout &layout)
+{
+    const Memory &memory = machine.memory;
+    if (!match_body(memory, cfa, PAUSE_BODY))
+    {
+        return false;
+    }
+    uint16_t list1 = memory[cfa];
+    uint16_t tos = memory[cfa + 3];
+    uint16_t follower = memory[cfa + 5];
+    uint16_t usr = memory[tos + 1];
+    uint16_t up = memory[usr + 1];
+    uint16_t wake = resolve_word(machine, {}, "_WAKE", "UWAKE");
+    uint16_t pass = resolve_word(machine, {}, "_PASS", "UPASS");
+    const std::pair<uint16_t, const std::vector<std::string> *> colons[] = {
+        {tos, &TOS_BODY}, {follower, &FOLLOWER_BODY}, {usr, &USR_BODY}, {up, &UP_BODY},
+        {memory[up + 1], &VAR_BODY}, {wake, &WAKE_BODY}, {pass, &PASS_BODY},
+    };
+    for (const auto &colon : colons)
+    {
+        if (colon.first == 0 || memory[colon.first] != list1 || !match_body(memory, colon.first, *colon.second))
+        {
+            return false;
+        }
+    }
+    if (memory[follower + 1] != usr || memory[wake + 2] != up || memory[wake + 4] != tos)
+    {
+        return false;
+    }
+
+    const uint16_t uses[] = {memory[cfa + 1], memory[cfa + 2], memory[cfa + 4], memory[cfa + 6], memory[cfa + 7],
+                             memory[usr + 3], memory[usr + 5], memory[wake + 6], memory[wake + 7], memory[pass + 1],
+                             memory[pass + 2], memory[pass + 3], memory[wake + 1], memory[wake + 3], memory[usr + 2]};
+    for (uint16_t primitive : uses)
+    {
+        bool known = false;
+        for (const PrimitiveCode &p : PAUSE_PRIMITIVES)
+        {
+            const std::string name = p.name;
+            if (primitive >= name.size() + 2 && header_name_is(memory, primitive - name.size() - 2, name))
+            {
+                uint16_t code = memory[primitive];
+                known = code + p.code.size() <= memory.size() &&
+                        std::equal(p.code.begin(), p.code.end(), memory.begin() + code);
+                break;
+            }
+        }
+        if (!known)
+        {
+            return false;
+        }
+    }
+    uint16_t exit = memory[cfa + 8];
+    if (memory[exit] + 5 != list1 ||
+        !std::equal(std::begin(EXIT_NEXT_CODE), std::end(EXIT_NEXT_CODE), memory.begin() + memory[exit]))
+    {
+        return false;
+    }
+
+    layout = {tos, usr, up, exit, wake, pass};
+    return true;
+}
+
+// PAUSE: the whole task switch, the chain of sleeping tasks walked in one go. Every cell
+// the guest code writes is written, the scratch cells below the pausing task's stack
+// pointers with the last value the guest leaves there.
+inline bool native_pause(Machine &machine, const PauseLayout &layout, uint16_t code)
+{
+    uint16_t *r = machine.registers;
+    const Memory &memory = machine.memory;
+    uint32_t d = r[2];
+    uint32_t rp = r[3];
+    if (r[0] != 0 || r[1] != 1 || r[9] != code - 3 || d < 5 || rp < 6 || !plain_memory(d - 4, 4) ||
+        !plain_memory(rp - 5, 5))
+    {
+        return false;
+    }
+
+    // cells written more than once; nothing else may be read from or written to them
+    auto scratch = [&](uint32_t address)
+    { return (address + 4 >= d && address + 2 <= d) || (address + 5 >= rp && address + 2 <= rp); };
+    auto usable = [&](uint32_t address)
+    { return plain_memory(address, 1) && !scratch(address); };
+
+    // PAUSE: RP@ SP@ TOS ! saves RP on the data stack and SP in TOS
+    uint16_t up_variable = layout.up + 2;
+    uint16_t up = memory[up_variable];
+    uint16_t tos = up - 2;
+    if (!usable(up_variable) || !usable(up) || !usable(tos))
+    {
+        return false;
+    }
+    auto peek = [&](uint16_t address)
+    { return address == tos ? static_cast<uint16_t>(d - 1) : address == d - 1 ? static_cast<uint16_t>(rp - 1)
+                                                             : address == rp - 1 ? r[4] : memory[address]; };
+
+    // FOLLOWER @ >R EXIT, then through every _PASS to the first _WAKE
+    uint16_t status = peek(up);
+    uint64_t passed = 0;
+    while (true)
+    {
+        if (!usable(status) || passed > 0xFFFF)
+        {
+            return false;
+        }
+        if (peek(status) == layout.wake)
+        {
+            break;
+        }
+        if (peek(status) != layout.pass || !usable(status + 1))
+        {
+            return false;
+        }
+        status = peek(status + 1);
+        passed++;
+    }
+
+    // _WAKE: R> UP ! TOS @ SP! RP! EXIT
+    uint16_t next_up = status + 1;
+    uint16_t next_tos = next_up - 2;
+    if (!usable(next_tos) || next_tos == up_variable)
+    {
+        return false;
+    }
+    uint16_t sp = peek(next_tos);
+    if (!usable(sp) || sp == up_variable)
+    {
+        return false;
+    }
+    uint16_t next_rp = peek(sp);
+    if (!usable(next_rp) || next_rp == up_variable)
+    {
+        return false;
+    }
+
+    machine.write(rp - 1, r[4]);
+    machine.write(d - 1, rp - 1);
+    machine.write(tos, d - 1);
+    machine.write(up_variable, next_up);
+    machine.write(rp - 2, layout.wake + 5);
+    machine.write(rp - 3, layout.tos + 2);
+    machine.write(rp - 4, layout.usr + 2);
+    machine.write(rp - 5, layout.up + 2);
+    machine.write(d - 2, sp);
+    machine.write(d - 3, 0xFFFE);
+    machine.write(d - 4, 0xFFFE);
+
+    r[2] = sp + 1;
+    r[3] = next_rp + 1;
+    r[4] = machine.memory[next_rp];
+    r[5] = layout.exit;
+    r[6] = sp;
+    r[PC] = code - 3;
+    machine.cycles += PAUSE_CYCLES + PASS_CYCLES * passed;
+    return true;
+}
+
+// A kernel word with a native replacement. The word is looked up by its table.txt label
+// (or by name when the table is out of date) and only hooked if the code its code field
+// points at is exactly code_template and, for colon words, its body matches body and
+// matches (when given) accepts it.
+// Words that are not exact leave guest-visible results as the guest code does, but not
+// the cycle count; they are off unless asked for.
+struct NativeWord
+{
+    std::string name;  // name in the dictionary
+    std::string label; // label in forth.asm / table.txt
+    const uint16_t *code_template;
+    size_t code_length;
+    std::function<bool(Machine &machine, uint16_t code)> run;
+    bool enabled;
+    bool exact;
+    std::vector<std::string> body;
+    std::function<bool(const Machine &machine, uint16_t cfa)> matches;
+};
+
+// The native words known to this emulator; the exact ones are enabled.
+inline std::vector<NativeWord> native_words()
+{
+    auto index = std::make_shared<DictionaryIndex>();
+    auto pause = std::make_shared<PauseLayout>();
+    return {
+        {"MOVE", "MOVE", MOVE_CODE, sizeof(MOVE_CODE) / sizeof(MOVE_CODE[0]), native_move, true, true, {}, nullptr},
+        {"FILL", "FILL", FILL_CODE, sizeof(FILL_CODE) / sizeof(FILL_CODE[0]), native_fill, true, true, {}, nullptr},
+        {"UM*", "UMSTA", UMSTAR_CODE, sizeof(UMSTAR_CODE) / sizeof(UMSTAR_CODE[0]), native_umstar, true, true, {}, nullptr},
+        {"UM/MOD", "UMMOD", UMMOD_CODE, sizeof(UMMOD_CODE) / sizeof(UMMOD_CODE[0]), native_ummod, true, true, {}, nullptr},
+        {"SFIND", "SFIND", LIST1_CODE, sizeof(LIST1_CODE) / sizeof(LIST1_CODE[0]),
+         [index](Machine &machine, uint16_t code) { return native_sfind(machine, *index, code); }, false, false,
+         SFIND_BODY, nullptr},
+        {"PAUSE", "PAUS", LIST1_CODE, sizeof(LIST1_CODE) / sizeof(LIST1_CODE[0]),
+         [pause](Machine &machine, uint16_t code) { return native_pause(machine, *pause, code); }, true, true, {},
+         [pause](const Machine &machine, uint16_t cfa) { return match_pause(machine, cfa, *pause); }},
+    };
+}
+
+// Enables or disables a native word by name. Returns false if there is no such word.
+inline bool set_native_word(std::vector<NativeWord> &words, const std::string &name, bool enabled)
+{
+    for (NativeWord &word : words)
+    {
+        if (word.name == name)
+        {
+            word.enabled = enabled;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hooks the code of every enabled word found in the image. A hook on code shared by several
+// words (the LIST1 entry of colon words) only runs when R5, set by NEXT1 and EXECUTE to the
+// code field being executed, is the word's own. Returns the names of the words it hooked.
+inline std::vector<std::string> install_native_words(Machine &machine,
+                                                     const std::unordered_map<std::string, uint16_t> &symbols,
+                                                     const std::vector<NativeWord> &words)
+{
+    struct Target
+    {
+        uint16_t cfa;
+        std::function<bool(Machine &, uint16_t)> run;
+    };
+    std::unordered_map<uint16_t, std::vector<Target>> entries;
+    std::vector<std::string> installed;
+    for (const NativeWord &word : words)
+    {
+        uint16_t cfa = word.enabled ? resolve_word(machine, symbols, word.name, word.label) : 0;
+        if (cfa == 0)
+        {
+            continue;
+        }
+        uint16_t code = machine.memory[cfa];
+        if (code + word.code_length > machine.memory.size() ||
+            !std::equal(word.code_template, word.code_template + word.code_length, &machine.memory[code]) ||
+            !match_body(machine.memory, cfa, word.body) || (word.matches && !word.matches(machine, cfa)))
+        {
+            continue;
+        }
+        entries[code].push_back({cfa, word.run});
+        installed.push_back(word.name);
+    }
+
+    for (auto &entry : entries)
+    {
+        uint16_t code = entry.first;
+        std::vector<Target> targets = entry.second;
+        machine.install_hook(code, [code, targets](Machine &m)
+                             {
+                                 for (const Target &target : targets)
+                                 {
+                                     if (target.cfa + 1 == code || m.registers[5] == target.cfa)
+                                     {
+                                         return target.run(m, code);
+                                     }
+                                 }
+                                 return false; });
+    }
+    return installed;
+}
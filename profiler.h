@@ -0,0 +1,277 @@
+// Sampling profiler for the guest. Every sample keeps the program counter, the Forth IP (R4)
+// and the return stack of the task that runs (counted once per distinct stack, so that the
+// samples stay in a few cache lines); they are put to names only for the report,
+// from the dictionary as it is then (so words defined during the run count too) and, for
+// code outside the dictionary, from table.txt.
+//   program counter: the code word whose body it is in, or (next) / (colon) in the inner
+//                    interpreter
+//   IP and every return stack cell that follows a call: the colon word whose body it is in
+//                    (other cells, put there by >R, are left out)
+#pragma once
+
+#include "dictionary.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Profiler
+{
+public:
+    // rp0 is where the return stack of the operator task starts (SUP holds it); frames
+    // are taken from up to max_depth cells below it.
+    explicit Profiler(uint16_t rp0, uint16_t max_depth = 64) : rp0(rp0), max_depth(max_depth), record(3 + max_depth) {}
+
+    void attach(Machine &machine, uint64_t period)
+    {
+        this->period = period;
+        machine.set_sampler(period, [this](Machine &m) { sample(m); });
+    }
+
+    void sample(const Machine &machine)
+    {
+        uint16_t rp = machine.registers[3];
+        uint16_t depth = rp <= rp0 && rp0 - rp <= max_depth ? rp0 - rp : 0;
+        record[0] = machine.registers[PC];
+        record[1] = machine.registers[4];
+        record[2] = depth;
+        std::copy_n(machine.memory.data() + rp0 - depth, depth, record.data() + 3);
+        add(record.data(), 1);
+        ++count;
+    }
+
+    size_t samples() const
+    {
+        return count;
+    }
+
+    // One line per distinct stack, outermost word first, and how many samples had it: the
+    // folded format flame graph tools read. ';' in a word name is written as "<semicolon>".
+    std::string folded(const Machine &machine, const std::unordered_map<std::string, uint16_t> &symbols) const
+    {
+        std::map<std::string, uint64_t> stacks;
+        each_stack(machine, symbols, [&](const std::vector<const std::string *> &frames, uint64_t samples) {
+            std::string line;
+            for (const std::string *frame : frames)
+            {
+                std::string name = *frame;
+                for (size_t at = name.find(';'); at != std::string::npos; at = name.find(';', at))
+                {
+                    name.replace(at, 1, "<semicolon>");
+                }
+                line += (line.empty() ? "" : ";") + name;
+            }
+            stacks[line] += samples;
+        });
+        std::string text;
+        for (const auto &stack : stacks)
+        {
+            text += stack.first + " " + std::to_string(stack.second) + "\n";
+        }
+        return text;
+    }
+
+    // The top words by samples in them (self) and by samples in them or what they called
+    // (total).
+    std::string report(const Machine &machine, const std::unordered_map<std::string, uint16_t> &symbols,
+                       size_t top = 20) const
+    {
+        std::unordered_map<std::string, uint64_t> self;
+        std::unordered_map<std::string, uint64_t> total;
+        each_stack(machine, symbols, [&](const std::vector<const std::string *> &frames, uint64_t samples) {
+            self[*frames.back()] += samples;
+            for (size_t i = 0; i < frames.size(); ++i)
+            {
+                if (std::find(frames.begin(), frames.begin() + i, frames[i]) == frames.begin() + i)
+                {
+                    total[*frames[i]] += samples; // recursion counts once
+                }
+            }
+        });
+
+        char line[128];
+        std::snprintf(line, sizeof(line), "%zu samples, one every %llu cycles\n", count,
+                      static_cast<unsigned long long>(period));
+        std::string text = line;
+        for (const auto *table : {&self, &total})
+        {
+            std::vector<std::pair<std::string, uint64_t>> rows(table->begin(), table->end());
+            std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+                return a.second != b.second ? a.second > b.second : a.first < b.first;
+            });
+            text += table == &self ? "\n  self%  samples  word\n" : "\n total%  samples  word\n";
+            for (size_t i = 0; i < rows.size() && i < top; ++i)
+            {
+                std::snprintf(line, sizeof(line), "%7.2f %8llu  %s\n", 100.0 * rows[i].second / std::max<size_t>(count, 1),
+                              static_cast<unsigned long long>(rows[i].second), rows[i].first.c_str());
+                text += line;
+            }
+        }
+        return text;
+    }
+
+private:
+    // Inner interpreter entry points relative to LIST1: NEXT1 is the three instructions
+    // before it, LIST1 itself is six.
+    static constexpr uint16_t NEXT_LENGTH = 3;
+    static constexpr uint16_t LIST_LENGTH = 6;
+
+    uint16_t rp0;
+    uint16_t max_depth;
+    uint64_t period = 0;
+    struct Stack
+    {
+        size_t offset; // in records
+        uint32_t length;
+        uint64_t count;
+    };
+
+    std::vector<uint16_t> record;  // the sample being taken
+    std::vector<uint16_t> records; // pc, ip, depth, depth return stack cells, per distinct stack
+    std::vector<Stack> stacks;
+    std::vector<uint32_t> slots = std::vector<uint32_t>(1024, 0); // stack index + 1, 0 when free
+    size_t count = 0;
+
+    // Counts samples more of the stack in record (pc, ip, depth, cells). Open addressing
+    // on the innermost cells, which tell most stacks apart already.
+    void add(const uint16_t *record, uint64_t samples)
+    {
+        uint32_t length = 3 + record[2];
+        uint64_t key = static_cast<uint64_t>(record[0]) | static_cast<uint64_t>(record[1]) << 16 |
+                       static_cast<uint64_t>(record[2]) << 32 | static_cast<uint64_t>(record[2] ? record[3] : 0) << 48;
+        size_t mask = slots.size() - 1;
+        for (size_t slot = (key * 0x9E3779B97F4A7C15ull) >> 40 & mask;; slot = (slot + 1) & mask)
+        {
+            if (slots[slot] == 0)
+            {
+                slots[slot] = static_cast<uint32_t>(stacks.size() + 1);
+                stacks.push_back({records.size(), length, samples});
+                records.insert(records.end(), record, record + length);
+                if (2 * stacks.size() > slots.size())
+                {
+                    rehash();
+                }
+                return;
+            }
+            Stack &stack = stacks[slots[slot] - 1];
+            if (stack.length == length && std::equal(record, record + length, records.begin() + stack.offset))
+            {
+                stack.count += samples;
+                return;
+            }
+        }
+    }
+
+    void rehash()
+    {
+        std::vector<Stack> old;
+        std::vector<uint16_t> cells;
+        old.swap(stacks);
+        cells.swap(records);
+        slots.assign(2 * slots.size(), 0);
+        for (const Stack &stack : old)
+        {
+            add(cells.data() + stack.offset, stack.count);
+        }
+    }
+
+    struct Region
+    {
+        uint16_t end;
+        std::string name;
+        bool colon;
+    };
+
+    // Calls visit with the frames of every distinct stack, outermost first, and its samples.
+    template <typename Visit>
+    void each_stack(const Machine &machine, const std::unordered_map<std::string, uint16_t> &symbols,
+                    Visit visit) const
+    {
+        const Memory &memory = machine.memory;
+        std::map<uint16_t, uint16_t> headers = find_headers(memory, VIDEO_MEMORY_START);
+        uint16_t list1 = colon_code(memory, headers);
+        uint16_t dp = resolve_word(machine, symbols, "DP", "DP");
+        uint16_t here = dp != 0 && match_body(memory, dp, {"_VAR"}) ? memory[dp + 2] : 0;
+        std::map<uint16_t, Region> regions; // by start
+        std::unordered_set<uint16_t> cfas;
+        std::unordered_set<uint16_t> data_words; // the rest of a body after these is data
+        for (const auto &header : headers)
+        {
+            uint16_t cfa = name_to_cfa(memory, header.second);
+            cfas.insert(cfa);
+            std::string name = header_name(memory, header.second);
+            if (name == "_VAR" || name == "_CON" || name == "_USR")
+            {
+                data_words.insert(cfa);
+            }
+        }
+        for (auto it = headers.begin(); it != headers.end(); ++it)
+        {
+            uint16_t cfa = name_to_cfa(memory, it->second);
+            auto next = std::next(it);
+            uint16_t end = next != headers.end() ? next->first : std::max<uint16_t>(here, cfa + 1);
+            bool colon = memory[cfa] == list1 && data_words.count(memory[cfa + 1]) == 0;
+            regions[cfa + 1] = {end, header_name(memory, it->second), colon};
+        }
+        regions[list1 - NEXT_LENGTH] = {list1, "(next)", false};
+        regions[list1] = {static_cast<uint16_t>(list1 + LIST_LENGTH), "(colon)", false};
+        std::map<uint16_t, std::string> labels; // for code outside the dictionary
+        for (const auto &symbol : symbols)
+        {
+            auto label = labels.emplace(symbol.second, symbol.first);
+            if (!label.second && symbol.first < label.first->second)
+            {
+                label.first->second = symbol.first;
+            }
+        }
+        std::string unknown = "?";
+
+        auto find = [&](uint16_t address, bool colon) -> const std::string * {
+            auto it = regions.upper_bound(address);
+            if (it != regions.begin() && address < (--it)->second.end && it->second.colon == colon)
+            {
+                return &it->second.name;
+            }
+            if (colon)
+            {
+                return nullptr;
+            }
+            auto label = labels.upper_bound(address);
+            return label == labels.begin() ? &unknown : &(--label)->second;
+        };
+
+        std::vector<const std::string *> frames;
+        for (const Stack &stack : stacks)
+        {
+            size_t i = stack.offset;
+            frames.clear();
+            for (size_t j = i + 3 + records[i + 2]; j > i + 3; --j)
+            {
+                uint16_t address = records[j - 1];
+                const std::string *word = address > 0 && cfas.count(memory[address - 1]) ? find(address, true) : nullptr;
+                if (word)
+                {
+                    frames.push_back(word);
+                }
+            }
+            if (const std::string *word = find(records[i + 1], true))
+            {
+                frames.push_back(word);
+            }
+            frames.push_back(find(records[i], false));
+            visit(frames, stack.count);
+        }
+    }
+};
+
+// Where the operator's return stack starts: the second cell of SUP, as COLD sets R3 from it.
+// Returns 0 when SUP is not the variable forth.asm makes.
+inline uint16_t find_rp0(const Machine &machine, const std::unordered_map<std::string, uint16_t> &symbols)
+{
+    uint16_t sup = resolve_word(machine, symbols, "SUP", "SUP");
+    return sup != 0 && match_body(machine.memory, sup, {"_VAR"}) ? machine.memory[sup + 3] : 0;
+}
@@ -0,0 +1,149 @@
+// Recording of the input a run took: every key the guest read from KEYBOARD_PORT and the
+// cycle it read it at. The keyboard is the machine's only input, so replaying the keys at
+// those cycles (and nothing at every other read, as the recorded run found) runs the guest
+// through the same states again, however and whenever the keys were first typed, and as fast
+// as the host can run it. Native hooks leave the machine as the guest code would, so the
+// replay can use other ones than the recording did; words that are not exact cannot.
+//   file: "SVEU16R1", the hash of the image at the start, the cycle the run ended at and the
+//         hash of its state then (8 bytes each, little-endian), the number of events, then per
+//         event the cycles since the one before and the key; numbers from the count on are
+//         LEB128, so that a key typed at the prompt takes four or five bytes.
+#pragma once
+
+#include "sveu16.h"
+
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Recording
+{
+    uint64_t image_hash = 0;
+    uint64_t end_cycle = 0;
+    uint64_t end_hash = 0;
+    std::vector<InputEvent> events;
+};
+
+namespace recording_detail
+{
+constexpr char MAGIC[8] = {'S', 'V', 'E', 'U', '1', '6', 'R', '1'};
+constexpr uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001B3ull;
+
+inline uint64_t hash_words(uint64_t hash, const uint16_t *words, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        hash = (hash ^ (words[i] & 0xFF)) * FNV_PRIME;
+        hash = (hash ^ (words[i] >> 8)) * FNV_PRIME;
+    }
+    return hash;
+}
+} // namespace recording_detail
+
+// FNV-1a of memory alone: what a recording starts from.
+inline uint64_t image_hash(const Machine &machine)
+{
+    return recording_detail::hash_words(recording_detail::FNV_OFFSET, machine.memory.data(), machine.memory.size());
+}
+
+// FNV-1a of memory, registers, cycles and console output: what a replay has to end at.
+inline uint64_t state_hash(const Machine &machine)
+{
+    using namespace recording_detail;
+    uint64_t hash = hash_words(FNV_OFFSET, machine.memory.data(), machine.memory.size());
+    hash = hash_words(hash, machine.registers, 16);
+    for (int i = 0; i < 8; ++i)
+    {
+        hash = (hash ^ ((machine.cycles >> (8 * i)) & 0xFF)) * FNV_PRIME;
+    }
+    for (char c : machine.console)
+    {
+        hash = (hash ^ static_cast<uint8_t>(c)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+inline void write_recording(std::ostream &out, const Recording &recording)
+{
+    auto put = [&](uint64_t value) {
+        for (int i = 0; i < 8; ++i)
+        {
+            out.put(static_cast<char>(value >> (8 * i)));
+        }
+    };
+    auto put_number = [&](uint64_t value) {
+        do
+        {
+            out.put(static_cast<char>((value & 0x7F) | (value > 0x7F ? 0x80 : 0)));
+            value >>= 7;
+        } while (value != 0);
+    };
+    out.write(recording_detail::MAGIC, sizeof(recording_detail::MAGIC));
+    put(recording.image_hash);
+    put(recording.end_cycle);
+    put(recording.end_hash);
+    put_number(recording.events.size());
+    uint64_t cycle = 0;
+    for (const InputEvent &event : recording.events)
+    {
+        put_number(event.cycle - cycle);
+        put_number(event.key);
+        cycle = event.cycle;
+    }
+}
+
+// Returns false, leaving recording empty, when in does not hold a whole recording.
+inline bool read_recording(std::istream &in, Recording &recording)
+{
+    recording = Recording();
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::string buffer = contents.str();
+    size_t pos = sizeof(recording_detail::MAGIC);
+    bool ok = buffer.compare(0, pos, recording_detail::MAGIC, pos) == 0;
+    auto get = [&]() {
+        uint64_t value = 0;
+        ok = ok && pos + 8 <= buffer.size();
+        for (int i = 0; ok && i < 8; ++i)
+        {
+            value |= static_cast<uint64_t>(static_cast<uint8_t>(buffer[pos++])) << (8 * i);
+        }
+        return value;
+    };
+    auto get_number = [&]() {
+        uint64_t value = 0;
+        for (int shift = 0; ok; shift += 7)
+        {
+            ok = pos < buffer.size() && shift < 64;
+            uint8_t byte = ok ? static_cast<uint8_t>(buffer[pos++]) : 0;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                break;
+            }
+        }
+        return value;
+    };
+    recording.image_hash = get();
+    recording.end_cycle = get();
+    recording.end_hash = get();
+    uint64_t count = get_number();
+    ok = ok && count <= (buffer.size() - pos) / 2; // two bytes an event at least
+    uint64_t cycle = 0;
+    for (uint64_t i = 0; ok && i < count; ++i)
+    {
+        cycle += get_number();
+        uint64_t key = get_number();
+        ok = ok && key <= 0xFFFF && cycle <= recording.end_cycle;
+        recording.events.push_back({cycle, static_cast<uint16_t>(key)});
+    }
+    if (!ok || pos != buffer.size())
+    {
+        recording = Recording();
+        return false;
+    }
+    return true;
+}
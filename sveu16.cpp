@@ -0,0 +1,2341 @@
+#include "sveu16.h"
+#include "arena.h"
+#include "assembler.h"
+#include "async.h"
+#include "bench.h"
+#include "disassembler.h"
+#include "gdb_stub.h"
+#include "history.h"
+#include "libsveu16.h"
+#include "native.h"
+#include "profiler.h"
+#include "recording.h"
+#include "viewer.h"
+#ifdef SVEU16_WORD_CYCLES
+#include "word_cycles.h"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <cassert>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <termios.h>
+#include <thread>
+
+// Reads the text on screen back from the framebuffer by matching every 8x8 cell against FONT.
+std::string screen_text(const Machine &machine, uint16_t font)
+{
+    std::string text;
+    for (int row = 0; row < 60; ++row)
+    {
+        std::string line;
+        for (int col = 0; col < 80; ++col)
+        {
+            uint8_t cell[8];
+            for (int i = 0; i < 8; ++i)
+            {
+                uint16_t word = machine.memory[VIDEO_MEMORY_START + row * 320 + i * 40 + col / 2];
+                cell[i] = (col & 1) ? (word & 0xFF) : (word >> 8);
+            }
+
+            char ch = '?';
+            for (int c = 0; c < 128; ++c)
+            {
+                bool same = true;
+                for (int i = 0; i < 8 && same; ++i)
+                {
+                    uint16_t word = machine.memory[font + 4 * c + i / 2];
+                    same = cell[i] == ((i & 1) ? (word & 0xFF) : (word >> 8));
+                }
+                if (same)
+                {
+                    ch = c < 32 ? ' ' : static_cast<char>(c);
+                    break;
+                }
+            }
+            line.push_back(ch);
+        }
+        line.erase(line.find_last_not_of(' ') + 1);
+        text += line + "\n";
+    }
+    text.erase(text.find_last_not_of('\n') + 1);
+    return text + "\n";
+}
+
+// Types text at the eForth prompt one line at a time (line ends become carriage returns),
+// letting each line finish before the next one is typed.
+void run_session(Machine &machine, const std::string &text)
+{
+    run_until_idle(machine);
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        machine.type(line + "\r");
+        run_until_idle(machine);
+    }
+}
+
+struct ViewStats
+{
+    uint64_t frames = 0;
+    uint64_t bytes = 0;    // written to the terminal
+    double seconds = 0;    // building frames
+};
+
+volatile std::sig_atomic_t view_interrupted = 0;
+
+// Writes all of text to fd, as one write() when the terminal takes it whole.
+void write_all(int fd, const std::string &text)
+{
+    for (size_t done = 0; done < text.size();)
+    {
+        ssize_t written = write(fd, text.data() + done, text.size() - done);
+        if (written <= 0)
+        {
+            return;
+        }
+        done += static_cast<size_t>(written);
+    }
+}
+
+// Runs the machine live on the terminal, drawing a frame fps times a second (up to frames of
+// them, 0 for no limit). Keys typed on a terminal stdin go to the guest until Ctrl-C, as they
+// are pressed or, when the terminal cannot be put in raw mode, a line at a time; stdin that
+// is not a terminal is typed a line at a time as run_session types it, and the view ends
+// when the guest has read it all.
+ViewStats view_session(Machine &machine, TerminalView &view, double fps, uint64_t frames)
+{
+    ViewStats stats;
+    bool terminal = isatty(STDIN_FILENO);
+    termios saved{};
+    bool raw_mode = terminal && tcgetattr(STDIN_FILENO, &saved) == 0;
+    int blocking = -1; // stdin's flags before O_NONBLOCK, when it was set
+    std::istringstream lines;
+    if (raw_mode)
+    {
+        termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    else if (terminal)
+    {
+        // a line at a time, but never waited for between frames
+        blocking = fcntl(STDIN_FILENO, F_GETFL);
+        if (blocking >= 0)
+        {
+            fcntl(STDIN_FILENO, F_SETFL, blocking | O_NONBLOCK);
+        }
+    }
+    else
+    {
+        std::stringstream input;
+        input << std::cin.rdbuf();
+        lines.str(input.str());
+    }
+    view_interrupted = 0;
+    auto interrupted = std::signal(SIGINT, [](int) { view_interrupted = 1; });
+
+    const auto period =
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1 / fps));
+    auto deadline = std::chrono::steady_clock::now();
+    bool typed_all = false;
+    while (!view_interrupted && (frames == 0 || stats.frames < frames))
+    {
+        deadline += period;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            if (!waiting_for_input(machine))
+            {
+                machine.run(10000);
+                continue;
+            }
+            std::string line;
+            if (!terminal && std::getline(lines, line))
+            {
+                machine.type(line + "\r");
+                continue;
+            }
+            typed_all = !terminal;
+            break;
+        }
+        char keys[64];
+        ssize_t count = terminal ? read(STDIN_FILENO, keys, sizeof(keys)) : 0;
+        for (ssize_t i = 0; i < count; ++i)
+        {
+            // the guest takes carriage returns and backspaces
+            machine.type(std::string(1, keys[i] == '\n' ? '\r' : keys[i] == 127 ? '\b' : keys[i]));
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        std::string text = view.frame(&machine.memory[VIDEO_MEMORY_START]);
+        stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        write_all(STDOUT_FILENO, text);
+        stats.frames++;
+        stats.bytes += text.size();
+        if (!terminal && typed_all)
+        {
+            break;
+        }
+        std::this_thread::sleep_until(deadline);
+    }
+
+    write_all(STDOUT_FILENO, view.restore());
+    std::signal(SIGINT, interrupted);
+    if (raw_mode)
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    }
+    if (blocking >= 0)
+    {
+        fcntl(STDIN_FILENO, F_SETFL, blocking);
+    }
+    return stats;
+}
+
+bool same_state(const Machine &a, const Machine &b)
+{
+    return a.memory == b.memory && std::equal(std::begin(a.registers), std::end(a.registers), b.registers) &&
+           a.cycles == b.cycles && a.console == b.console;
+}
+
+std::string read_text(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    std::stringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+// A new empty file in the temp directory with a name no other process has, ending in
+// suffix (the image formats go by it), for the tests to write and remove; empty when none
+// could be made.
+std::string temp_file(const std::string &suffix)
+{
+    std::string path = (std::filesystem::temp_directory_path() / ("sveu16_test_XXXXXX" + suffix)).string();
+    int fd = mkstemps(path.data(), static_cast<int>(suffix.size()));
+    if (fd < 0)
+    {
+        return "";
+    }
+    close(fd);
+    return path;
+}
+
+// The host side hot paths: every opcode over and over (the run loop and decode), keyboard
+// reads and console writes (the flagged read() and write() paths), reading the text back
+// from a full screen, copying a machine as snapshots do, profiler samples, writing recorded
+// input, a host call into a word through libsveu16, building a machine on the heap and in a
+// MachinePool, loading the image, raw and as a container, swapping a full image's bytes (per
+// byte), and turning the screen into terminal cells and into a frame's changes.
+std::vector<Microbenchmark> microbenchmarks(const std::string &image)
+{
+    static const char *const opcodes[] = {"LOD", "ADD", "SUB", "AND", "ORA", "XOR", "SHR", "MUL",
+                                          "STO", "MIF", "GTU", "GTS", "LTU", "LTS", "EQU", "MAJ"};
+    auto loop = [](std::vector<uint16_t> body) {
+        auto machine = std::make_shared<Machine>();
+        for (uint16_t i = 0; i < 4096; ++i)
+        {
+            machine->memory[0x1000 + i] = body[i % body.size()];
+        }
+        machine->memory[0x2000] = 0x0F0F; // LOD R15,R0,R15: back to the start
+        machine->memory[0x2001] = 0x1000;
+        machine->registers[2] = 0x8000;
+        machine->registers[3] = 5;
+        machine->registers[4] = 7;
+        machine->registers[6] = 1; // SHR: one to the right
+        machine->registers[7] = KEYBOARD_PORT;
+        machine->registers[8] = CONSOLE_PORT;
+        machine->registers[PC] = 0x1000;
+        return machine;
+    };
+    std::vector<Microbenchmark> benchmarks;
+    for (uint16_t op = LOD; op <= MAJ; ++op)
+    {
+        uint16_t word = op << 12 | 0x134; // Rd = R1, Ra = R3, Rb = R4
+        word = op == LOD || op == STO ? op << 12 | 0x102 : op == SHR ? 0x6136 : op == MAJ ? 0xF00F : word;
+        auto machine = loop({word}); // LOD and STO through R2, MAJ on to the next instruction
+        benchmarks.push_back({std::string("decode/") + opcodes[op], [machine](uint64_t iterations) {
+                                  machine->run(iterations);
+                                  return iterations;
+                              }});
+    }
+    auto keyboard = loop({0x0107}); // LOD R1,R0,R7
+    benchmarks.push_back({"mmio/keyboard_read", [keyboard](uint64_t iterations) {
+                              keyboard->run(iterations);
+                              return iterations;
+                          }});
+    auto console = loop({0x8108}); // STO R1,R0,R8
+    benchmarks.push_back({"mmio/console_write", [console](uint64_t iterations) {
+                              for (uint64_t done = 0; done < iterations; done += 65536)
+                              {
+                                  console->run(std::min<uint64_t>(iterations - done, 65536));
+                                  console->console.clear();
+                              }
+                              return iterations;
+                          }});
+
+    auto booted = std::make_shared<Machine>();
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+    DrawcharLayout layout;
+    if (!booted->load_memory(image) || !find_drawchar(*booted, symbols, layout))
+    {
+        return benchmarks;
+    }
+    install_drawchar_hooks(*booted, symbols);
+    install_native_words(*booted, symbols, native_words());
+    run_session(*booted, "WORDS");
+    uint16_t font = layout.font;
+    benchmarks.push_back({"screen/text", [booted, font](uint64_t iterations) {
+                              size_t length = 0;
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  length += screen_text(*booted, font).size();
+                              }
+                              return length > 0 ? iterations : 0;
+                          }});
+    benchmarks.push_back({"snapshot/save", [booted](uint64_t iterations) {
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  Machine copy = *booted;
+                              }
+                              return iterations;
+                          }});
+    auto scratch = std::make_shared<Machine>(*booted);
+    benchmarks.push_back({"snapshot/restore", [booted, scratch](uint64_t iterations) {
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  *scratch = *booted;
+                              }
+                              return iterations;
+                          }});
+    auto profiler = std::make_shared<Profiler>(find_rp0(*booted, symbols));
+    benchmarks.push_back({"profiler/sample", [booted, profiler](uint64_t iterations) {
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  profiler->sample(*booted);
+                              }
+                              return iterations;
+                          }});
+    auto recording = std::make_shared<Recording>();
+    for (uint16_t i = 0; i < 1000; ++i)
+    {
+        recording->events.push_back({200000ull * i + (i % 7) * 3000, static_cast<uint16_t>('A' + i % 26)});
+    }
+    benchmarks.push_back({"recording/write", [recording](uint64_t iterations) {
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  std::ostringstream out;
+                                  write_recording(out, *recording);
+                              }
+                              return iterations * recording->events.size();
+                          }});
+    auto vm = std::make_shared<sveu16::Vm>();
+    uint16_t plus = vm->load(image) && vm->run_until_idle() ? vm->find("+") : 0;
+    benchmarks.push_back({"embed/call_word", [vm, plus](uint64_t iterations) {
+                              const uint16_t args[] = {2, 3};
+                              uint16_t result[1];
+                              size_t count = 0;
+                              uint64_t calls = 0;
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  calls += vm->call(plus, args, result, count) && result[0] == 5;
+                              }
+                              return calls;
+                          }});
+    benchmarks.push_back({"machine/new_delete", [](uint64_t iterations) {
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  auto machine = std::make_unique<Machine>();
+                              }
+                              return iterations;
+                          }});
+    auto pool = std::make_shared<MachinePool>(1);
+    benchmarks.push_back({"machine/pool_acquire_release", [pool](uint64_t iterations) {
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  pool->release(pool->acquire());
+                              }
+                              return iterations;
+                          }});
+    benchmarks.push_back({"image/load", [image](uint64_t iterations) {
+                              Machine machine;
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  machine.load_memory(image);
+                              }
+                              return iterations;
+                          }});
+    // a file of its own for every run, removed with the last benchmark that loads it
+    std::string pattern = (std::filesystem::temp_directory_path() / "sveu16_microbench_XXXXXX").string();
+    int fd = mkstemp(pattern.data());
+    std::shared_ptr<const std::string> container(new std::string(fd >= 0 ? pattern : ""), [](const std::string *path) {
+        if (!path->empty())
+        {
+            std::remove(path->c_str());
+        }
+        delete path;
+    });
+    if (fd >= 0)
+    {
+        close(fd);
+        Machine machine;
+        machine.load_memory(image);
+        std::vector<uint16_t> words(machine.memory.begin(), machine.memory.end());
+        std::ofstream(*container, std::ios::binary) << container_image(words, 0, 0, read_text("table.txt"));
+    }
+    benchmarks.push_back({"image/swap_bytes", [](uint64_t iterations) {
+                              std::vector<uint16_t> memory(MEMORY_WORDS, 0x1234);
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  uint8_t *bytes = reinterpret_cast<uint8_t *>(memory.data());
+                                  swap_word_bytes(bytes, bytes, memory.size());
+                              }
+                              return iterations * memory.size() * 2;
+                          }});
+    auto screen = std::make_shared<Machine>();
+    if (screen->load_memory(image))
+    {
+        run_session(*screen, "WORDS");
+    }
+    benchmarks.push_back({"viewer/frame_cells", [screen](uint64_t iterations) {
+                              std::vector<uint8_t> cells;
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  frame_cells(&screen->memory[VIDEO_MEMORY_START], CellLayout(), cells);
+                              }
+                              return iterations * cells.size();
+                          }});
+    benchmarks.push_back({"viewer/frame", [screen](uint64_t iterations) {
+                              TerminalView view;
+                              uint16_t *video = &screen->memory[VIDEO_MEMORY_START];
+                              size_t bytes = view.frame(video).size();
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  video[(i * 7919) % VIDEO_MEMORY_WORDS] ^= 0x8001; // a few cells change
+                                  bytes += view.frame(video).size();
+                              }
+                              return iterations + (bytes == 0);
+                          }});
+    benchmarks.push_back({"image/load_container", [container](uint64_t iterations) {
+                              Machine machine;
+                              uint64_t loaded = 0;
+                              for (uint64_t i = 0; i < iterations; ++i)
+                              {
+                                  loaded += machine.load_memory(*container);
+                              }
+                              return loaded;
+                          }});
+    return benchmarks;
+}
+
+// Resident set size of the process, 0 where there is no /proc/self/statm.
+size_t resident_bytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// What a machine costs in memory, built on the heap and in a MachinePool: what it allocates
+// (counted through a CountingResource) and what loading the image into count of them adds
+// to the resident set, per machine, as JSON. The overhead is all but the 128K of guest memory.
+std::string footprint_json(const std::string &image, size_t count, const MemoryPolicy &policy)
+{
+    CountingResource counting;
+    {
+        Machine measured(&counting);
+    }
+    size_t allocations = counting.allocations;
+    size_t requested = sizeof(Machine) + counting.peak;
+
+    size_t before = resident_bytes();
+    std::vector<std::unique_ptr<Machine>> heap;
+    for (size_t i = 0; i < count; ++i)
+    {
+        heap.push_back(std::make_unique<Machine>());
+        heap.back()->load_memory(image);
+    }
+    size_t heap_resident = (resident_bytes() - before) / std::max<size_t>(count, 1);
+    heap.clear();
+
+    CountingResource upstream;
+    MachinePool pool(count, policy, &upstream);
+    before = resident_bytes();
+    for (size_t i = 0; i < pool.capacity; ++i)
+    {
+        pool.acquire()->load_memory(image);
+    }
+    size_t pool_resident = (resident_bytes() - before) / std::max<size_t>(count, 1);
+
+    const size_t guest = 65536 * sizeof(uint16_t);
+    auto record = [guest](size_t bytes, size_t allocations, size_t resident) {
+        char text[160];
+        std::snprintf(text, sizeof(text),
+                      "{\"bytes\": %zu, \"allocations\": %zu, \"resident_bytes\": %zu, \"overhead_bytes\": %zu}", bytes,
+                      allocations, resident, resident > guest ? resident - guest : 0);
+        return std::string(text);
+    };
+    return "{\n  \"machines\": " + std::to_string(count) + ",\n  \"guest_memory_bytes\": " + std::to_string(guest) +
+           ",\n  \"heap\": " + record(requested, allocations, heap_resident) +
+           ",\n  \"pool\": " + record(pool.slot_bytes, upstream.allocations, pool_resident) +
+           ",\n  \"huge_pages\": " + (pool.huge_pages ? "true" : "false") + "\n}\n";
+}
+
+void test_instructions()
+{
+    Machine machine;
+    machine.memory[0] = 0x022F; // LOD R2,R2,R15
+    machine.memory[1] = 0x1234; // WRD $1234
+    machine.memory[2] = 0x1322; // ADD R3,R2,R2
+    machine.memory[3] = 0xFBF2; // MAJ R11,R15,R2
+    machine.run(3);
+    assert(machine.registers[2] == 0x1234);
+    assert(machine.registers[3] == 0x2468);
+    assert(machine.registers[11] == 4);
+    assert(machine.registers[PC] == 0x1234);
+
+    assert(Machine::shift(0x8002, 0x01) == 0xC001);
+    assert(Machine::shift(0x8002, 0x11) == 0x4001);
+    assert(Machine::shift(0x8002, 0x21) == 0x0004);
+    assert(Machine::shift(0x12F0, 0x38) == 0xF012);
+    std::cout << "Instruction test passed." << std::endl;
+}
+
+// The assembler on the statement forms forth.asm uses, and on forth.asm itself, which must
+// give the image back word for word.
+void test_assembler(const std::string &source, const std::string &image)
+{
+    Assembly assembly;
+    std::string error;
+    assert(assemble("SIX CON 6\n"
+                    "START: LOD R5,R5,R15 ; comment\n"
+                    "       WRD DATA\n"
+                    "       ORA R15,R9,R9, : trailing text\n"
+                    "       ORG $10\n"
+                    "DATA   WRD -1\n"
+                    "       WRD SIX\n"
+                    "NAME:\n"
+                    "\tTXT \"A;B\"\n"
+                    "END\n",
+                    assembly, error));
+    assert((assembly.image == std::vector<uint16_t>{0x055F, 0x0010, 0x4F99, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                    0xFFFF, 0x0006, 'A', ';', 'B'}));
+    assert(symbol_table(assembly) == "END   15 \nNAME   12 \nDATA   10 \nSTART    0 \nSIX    6 \n");
+    assert(!assemble("       WRD NOWHERE\n", assembly, error) && error == "line 1: undefined symbol NOWHERE");
+    assert(!assemble("A: WRD 1\nA: WRD 2\n", assembly, error) && error == "line 2: duplicate label A");
+    assert(!assemble("\n   ADD R1,R16,R1\n", assembly, error) && error == "line 2: expected Rd,Ra,Rb, not R1,R16,R1");
+
+    std::string text = read_text(source);
+    assert(assemble(text, assembly, error));
+    std::string bytes = read_text(image);
+    assert(bytes.size() == assembly.image.size() * sizeof(uint16_t));
+    assert(std::equal(assembly.image.begin(), assembly.image.end(), reinterpret_cast<const uint16_t *>(bytes.data())));
+
+    // After a one word edit only its section is parsed again, also with the cache read back.
+    Assembler assembler;
+    Assembly incremental;
+    assert(assembler.assemble(text, incremental, error) && incremental.image == assembly.image);
+    std::string edited = text;
+    size_t at = edited.find("WRD $0606");
+    edited.replace(at, 9, "WRD $0607");
+    assert(assembler.assemble(edited, incremental, error) && assembler.parsed_sections() == 1);
+    Assembly full;
+    assert(assemble(edited, full, error) && incremental.image == full.image && incremental.symbols.size() == full.symbols.size());
+    std::stringstream cache;
+    assembler.write_cache(cache);
+    Assembler reloaded;
+    assert(reloaded.read_cache(cache));
+    assert(reloaded.assemble(text, incremental, error) && reloaded.parsed_sections() == 1);
+    assert(incremental.image == assembly.image && symbol_table(incremental) == symbol_table(assembly));
+    std::stringstream truncated(cache.str().substr(0, 100));
+    assert(!reloaded.read_cache(truncated));
+    std::cout << "Assembler test passed." << std::endl;
+}
+
+// The listing of the image must assemble back into it, and read as forth.asm does.
+void test_disassembler(const std::string &image)
+{
+    Machine machine;
+    assert(machine.load_memory(image));
+    std::unordered_map<uint16_t, std::string> labels = load_address_labels("table.txt");
+    assert(labels.at(0x0050) == "NEXT1" && labels.count(0x0040) == 0); // ECOMP is a constant
+    Disassembler disassembler(machine.memory, labels);
+    std::string listing = disassembler.listing();
+    Assembly assembly;
+    std::string error;
+    assert(assemble(listing, assembly, error));
+    assembly.image.resize(machine.memory.size(), 0);
+    assert(std::equal(assembly.image.begin(), assembly.image.end(), machine.memory.begin()));
+
+    assert(listing.find("RESET LOD R5,R5,R15           ; 0000 055F\n"
+                        "      WRD VCOLD               ; 0001") == 0);
+    assert(listing.find("TXT \"EXECUTE\"") != std::string::npos);
+    assert(disassembler.listing(0x50, 0x53) == "NEXT1 LOD R5,R5,R4            ; 0050 0554\n"
+                                                "      ADD R4,R4,R1            ; 0051 1441\n"
+                                                "NEXT2 LOD R15,R15,R5          ; 0052 0FF5\n");
+    uint16_t abort = resolve_word(machine, {}, "_ABORT\"", "UABOR");
+    std::string thread = disassembler.listing(abort, abort + 12);
+    assert(thread.find("UABOR WRD LIST1") == 0 && thread.find("WRD UABO1") != std::string::npos);
+    assert(thread.find("WRD $FFFE") != std::string::npos && thread.find("  -2\n") != std::string::npos);
+    assert(thread.find("UABO1 WRD UQUOT") != std::string::npos && thread.find("  _\"\n") != std::string::npos);
+
+    assert(dump_memory(machine.memory, 0, 10) == "0000: 055F 17D3 4F55 000D 0065 0046 006F 0072  ....eFor\n"
+                                                 "0008: 0074 0068                                th      \n");
+    std::string dump = dump_memory(machine.memory, 0xFF00, 0xFF40);
+    assert(dump == "FF00: 0000 0000 0000 0000 0000 0000 0000 0000  ........\n*\n");
+    std::cout << "Disassembler test passed." << std::endl;
+}
+
+void test_boot(const std::string &image)
+{
+    Machine machine;
+    assert(machine.load_memory(image));
+    DrawcharLayout layout;
+    assert(find_drawchar(machine, {}, layout));
+    run_session(machine, "DECIMAL 2 3 + .\n");
+    assert(screen_text(machine, layout.font).find("2 3 + . 5\nok") != std::string::npos);
+    std::cout << "Boot test passed." << std::endl;
+}
+
+// Calls DRAWCHAR directly with every character class and cursor position of interest and
+// compares the hook against interpreting the routine.
+void test_drawchar_hook(const std::string &image)
+{
+    Machine base;
+    assert(base.load_memory(image));
+    DrawcharLayout layout;
+    assert(find_drawchar(base, load_symbols("table.txt"), layout));
+
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < VIDEO_MEMORY_WORDS; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        base.memory[VIDEO_MEMORY_START + i] = seed >> 16;
+    }
+    const uint16_t return_address = 0x0100; // anywhere outside DRAWCHAR
+    for (uint16_t i = 0; i < 16; ++i)
+    {
+        base.registers[i] = 0x1111 * i;
+    }
+    base.registers[0] = 0;
+    base.registers[1] = 1;
+    base.registers[3] = 0xAE70;
+    base.registers[11] = return_address;
+
+    const uint16_t positions[][2] = {{0, 0}, {1, 1}, {2, 7}, {79, 10}, {78, 58}, {79, 59}, {0, 59}, {40, 30}};
+    const uint16_t characters[] = {0, 7, 8, 10, 13, 32, 'A', 'g', 127, 200, 255};
+    for (auto position : positions)
+    {
+        for (uint16_t ch : characters)
+        {
+            Machine interpreted = base;
+            interpreted.memory[layout.xval] = position[0];
+            interpreted.memory[layout.yval] = position[1];
+            interpreted.registers[5] = ch;
+            interpreted.registers[PC] = layout.entry;
+            Machine native = interpreted;
+
+            assert(interpreted.run_until(return_address, 200000));
+            assert(install_drawchar_hooks(native, {}));
+            native.step();
+            assert(native.registers[PC] == return_address);
+            assert(same_state(interpreted, native));
+        }
+    }
+
+    // SCROLL on its own, entered from interpreted DRAWCHAR
+    Machine interpreted = base;
+    interpreted.memory[layout.xval] = 5;
+    interpreted.memory[layout.yval] = 59;
+    interpreted.registers[5] = 10;
+    interpreted.registers[PC] = layout.entry;
+    Machine native = interpreted;
+    assert(interpreted.run_until(return_address, 200000));
+    assert(install_drawchar_hooks(native, {}, false, true));
+    assert(native.run_until(return_address, 200000));
+    assert(same_state(interpreted, native));
+    std::cout << "DRAWCHAR hook test passed." << std::endl;
+}
+
+// Calls the native words directly, the way NEXT1 enters them, and compares them against
+// interpreting the guest code: overlapping copies both ways, empty ranges, ranges that reach
+// the device ports (left to the guest code), and products and quotients across the range,
+// including UM/MOD overflow and division by zero.
+void test_native_words(const std::string &image)
+{
+    Machine base;
+    assert(base.load_memory(image));
+    uint32_t seed = 7;
+    auto random = [&seed]()
+    {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<uint16_t>(seed >> 16);
+    };
+    for (uint16_t address = 0x8000; address < 0x8100; ++address)
+    {
+        base.memory[address] = random();
+    }
+    const uint16_t return_address = 0x0100; // stands in for NEXT1
+    base.registers[0] = 0;
+    base.registers[1] = 1;
+    base.registers[2] = 0x9000;
+    base.registers[9] = return_address;
+
+    // stack arguments deepest first
+    auto check = [&](const char *name, uint16_t a, uint16_t b, uint16_t c, bool hooked)
+    {
+        Machine interpreted = base;
+        uint16_t cfa = resolve_word(interpreted, {}, name, name);
+        assert(cfa != 0);
+        interpreted.memory[0x9000] = c;
+        interpreted.memory[0x9001] = b;
+        interpreted.memory[0x9002] = a;
+        interpreted.registers[5] = cfa;
+        interpreted.registers[PC] = interpreted.memory[cfa];
+        Machine native = interpreted;
+
+        assert(interpreted.run_until(return_address, 1000000));
+        assert(install_native_words(native, {}, native_words()).size() == 5);
+        native.step();
+        assert((native.registers[PC] == return_address) == hooked);
+        assert(native.run_until(return_address, 1000000));
+        assert(same_state(interpreted, native));
+    };
+
+    check("MOVE", 0x8000, 0x8040, 16, true);
+    check("MOVE", 0x8010, 0x8000, 32, true);
+    check("MOVE", 0x8000, 0x8008, 32, true);
+    check("MOVE", 0x8020, 0x8020, 5, true);
+    check("MOVE", 0x8000, 0x8050, 0, true);
+    check("MOVE", 0x8000, 0xFFE8, 16, false);
+    check("MOVE", 0xFFF0, 0x8000, 4, false);
+    check("FILL", 0x8000, 64, 0xBEEF, true);
+    check("FILL", 0x8010, 0, 1, true);
+    check("FILL", 0xFFEE, 8, 0, false);
+
+    const uint16_t edges[] = {0, 1, 2, 10, 0x00FF, 0x0100, 0x7FFF, 0x8000, 0x8001, 0xFFFE, 0xFFFF};
+    for (uint16_t a : edges)
+    {
+        for (uint16_t b : edges)
+        {
+            check("UM*", 0, a, b, true);
+            for (uint16_t c : edges)
+            {
+                check("UM/MOD", a, b, c, true);
+            }
+        }
+    }
+    for (int i = 0; i < 2000; ++i)
+    {
+        uint16_t a = random();
+        uint16_t b = random();
+        uint16_t c = random() >> (i % 16);
+        check("UM*", 0, a, b, true);
+        check("UM/MOD", a, b, c, true);
+        check("UM/MOD", a, b % (c + 1), c, true);
+    }
+    std::cout << "Native word test passed." << std::endl;
+}
+
+// Calls SFIND the way NEXT1 does, with every name in the dictionary and some that are not,
+// and compares what the guest can see: stacks, IP and all memory but the dead cells below
+// the stack pointers.
+void test_sfind(const std::string &image)
+{
+    Machine base;
+    assert(base.load_memory(image));
+    run_session(base, "WORDLIST CONSTANT W  W SET-CURRENT : DUP 42 ; FORTH-WORDLIST SET-CURRENT\n"
+                      "GET-ORDER W SWAP 1 + SET-ORDER : DUP1 ;\n");
+    uint16_t cfa = resolve_word(base, {}, "SFIND", "SFIND");
+    assert(cfa != 0);
+    const uint16_t text = 0x9800;
+    const uint16_t thread = 0x9900; // IP to return to
+    uint16_t next1 = base.memory[cfa] - 3;
+
+    std::vector<std::string> names = {"DUP", "DUP1", "NOSUCH", "dup", "SFIN", "SFINDX", "", "ABCDEFGHIJKLMNOPQRSTUVWXYZ01234"};
+    for (uint32_t na = 1; na < 0x9000; ++na)
+    {
+        if (is_header(base.memory, na) && find_name(base, header_name(base.memory, na)) != 0)
+        {
+            names.push_back(header_name(base.memory, na));
+        }
+    }
+
+    std::vector<NativeWord> words = native_words();
+    set_native_word(words, "SFIND", true);
+    for (const std::string &name : names)
+    {
+        Machine interpreted = base;
+        for (size_t i = 0; i < name.size(); ++i)
+        {
+            interpreted.memory[text + i] = static_cast<uint8_t>(name[i]);
+        }
+        uint16_t *r = interpreted.registers;
+        r[2] -= 2;
+        interpreted.memory[r[2]] = name.size();
+        interpreted.memory[r[2] + 1] = text;
+        r[4] = thread;
+        r[5] = cfa;
+        r[PC] = interpreted.memory[cfa];
+        Machine native = interpreted;
+        uint16_t r2 = r[2];
+        uint16_t r3 = r[3];
+
+        do
+        {
+            interpreted.step();
+        } while (!(interpreted.registers[PC] == next1 && interpreted.registers[3] == r3));
+        assert(install_native_words(native, {}, words).size() == 6);
+        native.step();
+        assert(native.registers[PC] == next1);
+
+        for (int i : {2, 3, 4})
+        {
+            assert(native.registers[i] == interpreted.registers[i]);
+        }
+        for (uint32_t address = 0; address < native.memory.size(); ++address)
+        {
+            bool dead = (address + 1 < r2 && address + 64 >= r2) || (address + 1 < r3 && address + 64 >= r3);
+            assert(dead || native.memory[address] == interpreted.memory[address]);
+        }
+    }
+    std::cout << "SFIND test passed." << std::endl;
+}
+
+// Compilation with wordlists, search orders, redefinitions, IMMEDIATE and MARKER, with and
+// without native SFIND, must leave the same text on screen.
+void test_sfind_session(const std::string &image)
+{
+    const std::string session = "WORDLIST CONSTANT W  W SET-CURRENT : DUP 42 ; FORTH-WORDLIST SET-CURRENT\n"
+                                "7 DUP . .\n"
+                                "GET-ORDER W SWAP 1 + SET-ORDER  7 DUP . .\n"
+                                "GET-ORDER SWAP DROP 1 - SET-ORDER  7 DUP . .\n"
+                                "MARKER GONE : SQ DUP * ; 5 SQ . : SQ DUP DUP * * ; 5 SQ .\n"
+                                ": NOW 99 . ; IMMEDIATE : LATER NOW ; LATER\n"
+                                "GONE 5 SQ .\n"
+                                ": SQ 1 ; 5 SQ . . WORDS\n";
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+    std::string screens[2];
+    for (int native = 0; native < 2; ++native)
+    {
+        Machine machine;
+        assert(machine.load_memory(image));
+        std::vector<NativeWord> words = native_words();
+        set_native_word(words, "SFIND", native == 1);
+        assert(install_native_words(machine, symbols, words).size() == 5u + native);
+        run_session(machine, session);
+        DrawcharLayout layout;
+        assert(find_drawchar(machine, symbols, layout));
+        screens[native] = screen_text(machine, layout.font);
+    }
+    assert(screens[0] == screens[1]);
+    assert(screens[1].find("7 DUP . . 42 7") != std::string::npos);
+    std::cout << "SFIND session test passed." << std::endl;
+}
+
+// Samples of a busy colon word must come one per period and be put to that word, called from
+// the interpreter, with the loop body's words under it.
+void test_profiler(const std::string &image)
+{
+    Machine machine;
+    assert(machine.load_memory(image));
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+    install_native_words(machine, symbols, native_words());
+    run_session(machine, "DECIMAL : BUSY 3000 BEGIN 1 - DUP 0= UNTIL DROP ;");
+    Profiler profiler(find_rp0(machine, symbols));
+    assert(profiler.samples() == 0);
+    profiler.attach(machine, 1000);
+    uint64_t start = machine.cycles;
+    run_session(machine, "BUSY BUSY");
+    uint64_t expected = (machine.cycles - start) / 1000;
+    assert(profiler.samples() + 1 >= expected && profiler.samples() <= expected + 1);
+
+    std::string folded = profiler.folded(machine, symbols);
+    std::istringstream lines(folded);
+    std::string stack;
+    uint64_t count;
+    uint64_t total = 0;
+    uint64_t busy = 0;
+    while (lines >> stack >> count)
+    {
+        total += count;
+        busy += stack.find(";BUSY;") != std::string::npos ? count : 0;
+    }
+    assert(total == profiler.samples());
+    assert(busy * 2 > total);
+    std::string report = profiler.report(machine, symbols, 5);
+    assert(report.find("  BUSY\n") != std::string::npos);
+    std::cout << "Profiler test passed." << std::endl;
+}
+
+// A recorded session replayed on a machine without native hooks must read every key at the
+// cycle it was recorded at and end in the same state; a key read one cycle late must not.
+void test_recording(const std::string &image)
+{
+    Machine machine;
+    assert(machine.load_memory(image));
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+    install_drawchar_hooks(machine, symbols);
+    install_native_words(machine, symbols, native_words());
+    Recording recorded;
+    recorded.image_hash = image_hash(machine);
+    machine.input_log = &recorded.events;
+    run_session(machine, "1 2 + .\nWORDS");
+    recorded.end_cycle = machine.cycles;
+    recorded.end_hash = state_hash(machine);
+    assert(recorded.events.size() == 14);
+
+    std::stringstream file;
+    write_recording(file, recorded);
+    assert(file.str().size() < 8 * 4 + 1 + 5 * recorded.events.size());
+    Recording recording;
+    std::istringstream truncated(file.str().substr(0, file.str().size() - 1));
+    assert(!read_recording(truncated, recording) && recording.events.empty());
+    assert(read_recording(file, recording));
+
+    auto replay = [&](const std::vector<InputEvent> &events) {
+        Machine replayed;
+        assert(replayed.load_memory(image));
+        assert(image_hash(replayed) == recording.image_hash);
+        replayed.input_replay = &events;
+        replayed.run(recording.end_cycle);
+        return replayed;
+    };
+    Machine replayed = replay(recording.events);
+    assert(replayed.input_replayed == recorded.events.size());
+    assert(state_hash(replayed) == recording.end_hash && same_state(replayed, machine));
+
+    std::vector<InputEvent> late = recording.events;
+    late[3].cycle++;
+    replayed = replay(late);
+    assert(replayed.input_replayed == 3 && state_hash(replayed) != recording.end_hash);
+    std::cout << "Recording test passed." << std::endl;
+}
+
+// Skipping the rounds of the polling loop must end where running them does, with the
+// profiler sampling through them and with recorded keys coming in between them.
+void test_skip_idle(const std::string &image)
+{
+    Machine machine;
+    assert(machine.load_memory(image));
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+    install_drawchar_hooks(machine, symbols);
+    install_native_words(machine, symbols, native_words());
+    run_until_idle(machine);
+    Machine booted = machine;
+
+    Recording recording;
+    machine.input_log = &recording.events;
+    Profiler profiler(find_rp0(machine, symbols));
+    profiler.attach(machine, 997);
+    for (char key : std::string("3 4 + 8000 !\r"))
+    {
+        machine.run(300000);
+        machine.keyboard.push_back(static_cast<uint8_t>(key));
+    }
+    machine.run(2000000);
+    assert(machine.memory[0x8000] == 7 && recording.events.size() == 13);
+
+    Machine skipped = booted;
+    skipped.skip_idle = true;
+    skipped.input_replay = &recording.events;
+    Profiler sampled(find_rp0(skipped, symbols));
+    sampled.attach(skipped, 997);
+    skipped.run(machine.cycles - booted.cycles);
+    assert(same_state(skipped, machine) && skipped.input_replayed == 13);
+    assert(sampled.report(skipped, symbols, 10) == profiler.report(machine, symbols, 10));
+    assert(skipped.skipped_cycles > 1000000);
+
+    skipped = booted;
+    skipped.skip_idle = true;
+    skipped.run(100000000);
+    assert(skipped.cycles - booted.cycles - 100000000 < 1000 && skipped.skipped_cycles > 99000000);
+    assert(waiting_for_input(skipped));
+    std::cout << "Skip idle test passed." << std::endl;
+}
+
+// Every workload must leave what it computes, with cycles and words counted; one expecting
+// something else must fail the suite and name itself.
+void test_bench(const std::string &image)
+{
+    Machine machine;
+    assert(machine.load_memory(image));
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+    install_drawchar_hooks(machine, symbols);
+    install_native_words(machine, symbols, native_words());
+    run_until_idle(machine);
+    std::vector<Workload> workloads = bench_workloads();
+    std::vector<BenchResult> results;
+    std::string error;
+    assert(run_bench(machine, workloads, 2, results, error));
+    assert(results.size() == workloads.size());
+    for (const BenchResult &result : results)
+    {
+        assert(result.seconds.size() == 2 && result.words > 0 && result.cycles > 2 * result.words);
+    }
+    std::string json = bench_json(image, 2, results);
+    assert(json.find("\"name\": \"sieve\", \"cycles\": " + std::to_string(results[0].cycles)) != std::string::npos);
+    assert(json.find("\"total\": {\"name\": \"total\"") != std::string::npos);
+
+    workloads = {workloads[1]};
+    workloads[0].expect++;
+    assert(!run_bench(machine, workloads, 1, results, error) && error == "fib: left 17711 instead of 17712");
+    std::cout << "Bench test passed." << std::endl;
+}
+
+// A device mapped into memory must see what the guest reads and stores there, through a Vm
+// as a host embeds it, and nothing once detached; another Vm must not see it.
+void test_embedding(const std::string &image)
+{
+    struct Doubler : Device
+    {
+        uint16_t value = 21;
+        uint64_t reads = 0;
+        uint64_t last_write = 0;
+        uint16_t read(uint16_t, uint64_t) override
+        {
+            ++reads;
+            return value;
+        }
+        void write(uint16_t, uint16_t stored, uint64_t cycle) override
+        {
+            value = stored;
+            last_write = cycle;
+        }
+    } doubler;
+
+    sveu16::Vm vm;
+    assert(vm.load(image) && vm.install_native());
+    assert(vm.attach(0xFFF0, doubler) && !vm.attach(KEYBOARD_PORT, doubler));
+    assert(vm.run_until_idle());
+    vm.type("HEX FFF0 @ 2 * FFF0 ! FFF0 @ 8000 !\r");
+    assert(vm.run_until_idle());
+    assert(doubler.reads == 2 && doubler.value == 42 && doubler.last_write > 0 && doubler.last_write < vm.cycles());
+    assert(vm.peek(0xFFF0) == 42 && vm.peek(0x8000) == 42);
+
+    sveu16::Vm other;
+    assert(other.load(image) && other.run_until_idle());
+    other.type("HEX FFF0 @ 1 + 8000 !\r");
+    assert(other.run_until_idle() && other.peek(0x8000) == 1 && doubler.reads == 2);
+    vm.detach(0xFFF0);
+    vm.poke(0xFFF0, 7);
+    vm.type("FFF0 @ 8000 !\r");
+    assert(vm.run_until_idle() && doubler.reads == 2 && vm.peek(0x8000) == 7);
+
+    // a new image must find the Vm as built: no native hooks, breakpoints, watchpoints,
+    // devices, keys or output left from the last one
+    assert(vm.attach(0xFFF0, doubler));
+    vm.machine().set_breakpoint(vm.reg(PC), true);
+    vm.machine().set_watchpoint(0x8000, true, true, true);
+    vm.type("FFF0 @ 8000 !\r");
+    assert(vm.load(image));
+    sveu16::Vm fresh;
+    assert(fresh.load(image));
+    assert(vm.run_until_idle() && fresh.run_until_idle());
+    assert(vm.cycles() == fresh.cycles() && vm.take_console() == fresh.take_console());
+    assert(std::equal(vm.memory().begin(), vm.memory().end(), fresh.memory().begin()));
+    vm.type("HEX FFF0 @ 8000 !\r");
+    assert(vm.run_until_idle() && vm.machine().stop.reason == StopReason::NONE);
+    assert(doubler.reads == 2 && vm.peek(0x8000) == 0);
+    std::cout << "Embedding test passed." << std::endl;
+}
+
+// A host call must run the newest definition of a word with its arguments on the data stack
+// and hand back what it leaves, and leave the guest as it was, even when the word fails.
+void test_call_word(const std::string &image)
+{
+    sveu16::Vm vm;
+    assert(vm.load(image) && vm.install_native() && vm.run_until_idle());
+    vm.type(": SQ DUP * ;\r: SQ DUP DUP * * ;\r: SPLIT SWAP OVER OVER + ;\r: SPIN BEGIN 0 UNTIL ;\r");
+    assert(vm.run_until_idle());
+
+    uint16_t registers[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        registers[i] = vm.reg(i);
+    }
+    size_t depth = vm.data_stack().size();
+    assert(vm.call_word("+", 2, 3) == std::vector<uint16_t>{5});
+    assert(vm.call_word("SQ", 3) == std::vector<uint16_t>{27});
+    assert(vm.call_word("SPLIT", 2, 3) == std::vector<uint16_t>({3, 2, 5}));
+    std::optional<std::vector<uint16_t>> base = vm.call_word("BASE");
+    assert(base && base->size() == 1 && vm.memory()[base->front()] == 16); // eForth starts in HEX
+    assert(vm.find("NOSUCH") == 0 && !vm.call_word("NOSUCH"));
+    assert(!vm.call_word("DROP")); // takes the guest's own stack
+
+    uint16_t results[2];
+    size_t count = 0;
+    assert(!vm.call(vm.find("SPIN"), {}, results, count, 10000) && count == 0);
+    assert(vm.call(vm.find("SPLIT"), std::vector<uint16_t>{1, 2}, std::span<uint16_t>(results, 1), count) &&
+           count == 3 && results[0] == 2);
+    for (int i = 0; i < 16; ++i)
+    {
+        assert(vm.reg(i) == registers[i]);
+    }
+    assert(vm.data_stack().size() == depth);
+
+    vm.push(7);
+    assert(vm.data_stack().size() == depth + 1 && vm.data_stack()[0] == 7 && vm.pop() == 7);
+    assert(vm.memory().data() == &vm.machine().memory[0] && vm.memory().size() == 0x10000);
+    vm.type("4 SQ 8000 !\r");
+    assert(vm.run_until_idle() && vm.peek(0x8000) == 64);
+    std::cout << "Call word test passed." << std::endl;
+}
+
+// One Vm's session for test_scheduler: boot, store n, spin past the budget, stop at a
+// breakpoint. passed counts the sessions that saw every event they should.
+sveu16::Task scheduled_session(sveu16::Scheduler &scheduler, sveu16::Vm &vm, int n, std::atomic<int> &passed)
+{
+    bool ok = co_await scheduler.run(vm) == sveu16::Event::INPUT;
+    vm.type(": SPIN BEGIN 0 UNTIL ;\rDECIMAL " + std::to_string(n) + " HEX 8000 !\r");
+    ok = ok && co_await scheduler.run(vm) == sveu16::Event::INPUT && vm.peek(0x8000) == n;
+    vm.type("SPIN\r");
+    uint64_t start = vm.cycles();
+    ok = ok && co_await scheduler.run(vm, 500000) == sveu16::Event::BUDGET && vm.cycles() - start < 520000;
+    vm.machine().set_breakpoint(vm.reg(PC), true);
+    ok = ok && co_await scheduler.run(vm) == sveu16::Event::HALT;
+    passed += ok;
+}
+
+// Many sessions interleaved on a few threads must each see their own events.
+void test_scheduler(const std::string &image)
+{
+    std::vector<sveu16::Vm> vms(24);
+    std::atomic<int> passed{0};
+    {
+        sveu16::Scheduler scheduler(3, 50000);
+        for (size_t i = 0; i < vms.size(); ++i)
+        {
+            assert(vms[i].load(image));
+            scheduled_session(scheduler, vms[i], static_cast<int>(i) * 100, passed);
+        }
+        scheduler.wait();
+        assert(passed == static_cast<int>(vms.size()));
+
+    }
+    std::cout << "Scheduler test passed." << std::endl;
+}
+
+// Machines from a pool must come from its arena without touching the heap, run as machines
+// on the heap do, go back to the heap only for what outgrows the slot, and be recycled; the
+// memory policy must parse as --memory gives it.
+void test_machine_pool(const std::string &image)
+{
+    CountingResource upstream;
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+    {
+        MachinePool pool(4, MemoryPolicy(), &upstream);
+        assert(pool.capacity == 4 && pool.slot_bytes >= 4 * 65536 && pool.slot_bytes < 5 * 65536);
+        Machine *machines[4];
+        for (Machine *&machine : machines)
+        {
+            machine = pool.acquire();
+            assert(machine && machine->memory.size() == 65536 && machine->registers[PC] == 0);
+        }
+        assert(!pool.acquire() && pool.in_use() == 4 && upstream.allocations == 0);
+        assert(reinterpret_cast<char *>(machines[1]) - reinterpret_cast<char *>(machines[0]) ==
+               static_cast<ptrdiff_t>(pool.slot_bytes));
+
+        Machine heap;
+        for (Machine *machine : {machines[2], &heap})
+        {
+            assert(machine->load_memory(image));
+            install_drawchar_hooks(*machine, symbols);
+            install_native_words(*machine, symbols, native_words());
+            run_session(*machine, "1 2 + 8000 !");
+        }
+        assert(same_state(*machines[2], heap) && heap.memory[0x8000] == 3);
+
+        machines[3]->type(std::string(5000, ' '));
+        assert(upstream.allocations > 0 && upstream.bytes > 0);
+        pool.release(machines[3]);
+        assert(upstream.bytes == 0 && pool.in_use() == 3);
+        Machine *recycled = pool.acquire();
+        assert(recycled == machines[3] && recycled->keyboard.empty());
+    }
+    assert(upstream.bytes == 0);
+
+    MemoryPolicy policy;
+    assert(policy.parse("thp") && policy.pages == PageSize::TRANSPARENT_HUGE && !policy.lock && !policy.prefault);
+    assert(!policy.parse("mlock") && !policy.parse("thp+huge") && !policy.parse("thp+"));
+    assert(policy.parse("small+prefault") && policy.pages == PageSize::SMALL && policy.prefault && !policy.lock);
+    MachinePool prefaulted(2, policy);
+    assert(prefaulted.capacity == 2 && !prefaulted.huge_pages && prefaulted.acquire());
+    std::cout << "Machine pool test passed." << std::endl;
+}
+
+// Containers must load as the raw image does, with their symbols and entry point, and no
+// file that is short, corrupt or from another version may load at all.
+void test_image(const std::string &image)
+{
+    Machine raw;
+    ImageInfo info;
+    std::string error;
+    assert(raw.load_memory(image, info, error) && !info.container && info.words == read_text(image).size() / 2);
+    std::vector<uint16_t> words(raw.memory.begin(), raw.memory.begin() + info.words);
+    std::string symbols = read_text("table.txt");
+    std::string bytes = container_image(words, 0, 0, symbols);
+
+    std::string path = temp_file(".img");
+    assert(!path.empty() && std::ofstream(path, std::ios::binary) << bytes);
+    Machine packed;
+    packed.registers[PC] = 0x1234;
+    assert(packed.load_memory(path, info, error));
+    assert(info.container && info.words == words.size() && info.symbols == symbols && packed.registers[PC] == 0);
+    assert(packed.memory == raw.memory);
+    std::istringstream embedded(info.symbols);
+    assert(parse_symbols(embedded) == load_symbols("table.txt"));
+    run_session(packed, "1 2 + 8000 !");
+    assert(packed.memory[0x8000] == 3);
+    std::remove(path.c_str());
+
+    std::vector<uint16_t> memory(MEMORY_WORDS, 0xAAAA);
+    auto parse = [&memory, &info, &error](const std::string &file) {
+        return parse_image(reinterpret_cast<const uint8_t *>(file.data()), file.size(), memory.data(), info, error);
+    };
+    std::string placed = container_image({0x1111, 0x2222}, 0xFFFE, 0xFFFF, "");
+    assert(parse(placed) && info.load_address == 0xFFFE && info.entry == 0xFFFF && info.symbols.empty());
+    assert(memory[0xFFFD] == 0xAAAA && memory[0xFFFE] == 0x1111 && memory[0xFFFF] == 0x2222);
+    assert(parse(std::string("\x34\x12", 2)) && !info.container && memory[0] == 0x1234);
+
+    std::vector<uint16_t> before = memory;
+    std::string corrupt = bytes;
+    corrupt[IMAGE_HEADER_BYTES + 100] ^= 1;
+    std::string version = bytes;
+    version[8] = 2;
+    std::string flags = bytes;
+    flags[10] = 3;
+    std::string overflow = container_image({1, 2, 3}, 0xFFFE, 0, "");
+    for (const std::string &file : {std::string(), std::string("\x01\x02\x03", 3), bytes.substr(0, 20),
+                                    bytes.substr(0, bytes.size() - 1), bytes + "x", corrupt, version, flags, overflow})
+    {
+        assert(!parse(file) && !error.empty());
+        error.clear();
+    }
+    assert(memory == before);
+    assert(!packed.load_memory("no such image", info, error) && error.find("no such image") != std::string::npos);
+    std::cout << "Image test passed." << std::endl;
+}
+
+// Words must come out of every format in the byte order they went in, the vector byte swap
+// must agree with swapping one word at a time at every length and alignment, and Intel HEX
+// must round-trip across 64K byte boundaries and reject what is not a valid record.
+void test_image_formats(const std::string &image)
+{
+    std::vector<uint8_t> bytes(200);
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        bytes[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+    for (size_t offset : {0, 1, 2})
+    {
+        for (size_t count = 0; count < 40; ++count)
+        {
+            std::vector<uint8_t> swapped(bytes);
+            swap_word_bytes(bytes.data() + offset, swapped.data() + offset, count);
+            std::vector<uint8_t> in_place(bytes);
+            swap_word_bytes(in_place.data() + offset, in_place.data() + offset, count);
+            for (size_t i = 0; i < bytes.size(); ++i)
+            {
+                bool inside = i >= offset && i < offset + 2 * count;
+                uint8_t expected = inside ? bytes[offset + ((i - offset) ^ 1)] : bytes[i];
+                assert(swapped[i] == expected && in_place[i] == expected);
+            }
+        }
+    }
+
+    const uint16_t words[] = {0x1234, 0xABCD, 0x00FF};
+    assert(raw_image(words, 3, ByteOrder::LITTLE) == std::string("\x34\x12\xCD\xAB\xFF\x00", 6));
+    assert(raw_image(words, 3, ByteOrder::BIG) == std::string("\x12\x34\xAB\xCD\x00\xFF", 6));
+    std::vector<uint16_t> memory(MEMORY_WORDS);
+    ImageInfo info;
+    std::string error;
+    std::string big = raw_image(words, 3, ByteOrder::BIG);
+    assert(parse_image(reinterpret_cast<const uint8_t *>(big.data()), big.size(), memory.data(), info, error,
+                       ByteOrder::BIG));
+    assert(std::equal(words, words + 3, memory.begin()) && info.words == 3);
+
+    assert(intel_hex(words, 3, 0x10) == ":060020003412CDABFF001D\n:00000001FF\n");
+    Machine raw;
+    assert(raw.load_memory(image));
+    for (ByteOrder order : {ByteOrder::LITTLE, ByteOrder::BIG})
+    {
+        std::string text = intel_hex(raw.memory.data() + 0x7FF0, 0x8010, 0x7FF0, order);
+        assert(text.find(":020000040001F9\n:10000000") != std::string::npos);
+        std::fill(memory.begin(), memory.end(), 0);
+        assert(parse_intel_hex(text, memory.data(), info, error, order));
+        assert(info.load_address == 0x7FF0 && info.words == 0x8010 && memory[0x7FEF] == 0);
+        assert(std::equal(memory.begin() + 0x7FF0, memory.end(), raw.memory.begin() + 0x7FF0));
+    }
+
+    std::string path = temp_file(".hex");
+    assert(!path.empty() && std::ofstream(path) << intel_hex(raw.memory.data(), 0x1000, 0, ByteOrder::BIG));
+    Machine hex;
+    assert(hex.load_memory(path, info, error, ByteOrder::BIG) && info.words == 0x1000 && !info.container);
+    assert(std::equal(hex.memory.begin(), hex.memory.begin() + 0x1000, raw.memory.begin()));
+    std::remove(path.c_str());
+
+    std::fill(memory.begin(), memory.end(), 0xAAAA);
+    for (const char *text : {":0600200034", ":060020003412CDABFF001E\n:00000001FF\n", ":06002000341XCDABFF001D\n",
+                             ":060020003412CDABFF001D\n", ":00000001FF\n", ":0100000600F9\n:00000001FF\n",
+                             ":020000040002F8\n:0100000000FF\n:00000001FF\n"})
+    {
+        assert(!parse_intel_hex(text, memory.data(), info, error) && !error.empty());
+        error.clear();
+    }
+    assert(std::all_of(memory.begin(), memory.end(), [](uint16_t word) { return word == 0xAAAA; }));
+
+    path = temp_file(".mem");
+    assert(!path.empty() && save_image(path, std::vector<uint16_t>(words, words + 3)));
+    assert(read_text(path) == std::string("\x34\x12\xCD\xAB\xFF\x00", 6));
+    std::remove(path.c_str());
+    std::cout << "Image formats test passed." << std::endl;
+}
+
+// The screen as terminal cells, with dot (x, y) of a cell lit when any pixel under it is.
+uint8_t reference_cell(const uint16_t *video, const CellLayout &layout, int column, int row)
+{
+    uint8_t cell = 0;
+    for (int across = 0; across < layout.dots_across(); ++across)
+    {
+        for (int down = 0; down < layout.dots_down(); ++down)
+        {
+            for (int i = 0; i < layout.scale * layout.scale; ++i)
+            {
+                int x = (column * layout.dots_across() + across) * layout.scale + i % layout.scale;
+                int y = (row * layout.dots_down() + down) * layout.scale + i / layout.scale;
+                if (video[y * 40 + x / 16] >> (15 - x % 16) & 1)
+                {
+                    cell |= layout.dot_bit(across, down);
+                }
+            }
+        }
+    }
+    return cell;
+}
+
+// Cells must match a pixel by pixel reference in every mode and scale, and frames must carry
+// just the cells that changed.
+void test_viewer(const std::string &image)
+{
+    std::vector<uint16_t> video(VIDEO_MEMORY_WORDS);
+    uint32_t random = 12345;
+    for (uint16_t &word : video)
+    {
+        random = random * 1103515245 + 12345;
+        word = static_cast<uint16_t>((random >> 16) & (random >> 8)); // sparse, so not every dot is lit
+    }
+    std::vector<uint8_t> cells;
+    for (CellMode mode : {CellMode::BRAILLE, CellMode::HALF_BLOCK})
+    {
+        for (int scale : {1, 2, 4})
+        {
+            CellLayout layout{mode, scale};
+            frame_cells(video.data(), layout, cells);
+            assert(cells.size() == static_cast<size_t>(layout.columns() * layout.rows()));
+            for (int row = 0; row < layout.rows(); ++row)
+            {
+                for (int column = 0; column < layout.columns(); ++column)
+                {
+                    assert(cells[row * layout.columns() + column] == reference_cell(video.data(), layout, column, row));
+                }
+            }
+        }
+    }
+    CellLayout braille;
+    assert(braille.columns() == 160 && braille.rows() == 60);
+
+    std::fill(video.begin(), video.end(), 0);
+    TerminalView view(CellLayout{CellMode::BRAILLE, 1});
+    assert(view.frame(video.data()) == "\x1b[?25l\x1b[H\x1b[2J");
+    assert(view.frame(video.data()).empty());
+    video[0] = 0x8000;                  // dot 1 of the top left cell
+    video[40 * 3 + 39] = 0x0001;        // dot 8 of the top right one
+    assert(view.frame(video.data()) == "\x1b[1;1H\u2801\x1b[1;320H\u2880");
+    video[1] = 0x4000;                  // 9 cells along: joined, not worth a cursor move
+    assert(view.frame(video.data()) == "\x1b[1;9H\u2808");
+    video[0] = 0;
+    video[1] = 0;
+    assert(view.frame(video.data()) == "\x1b[1;1H         ");
+    view.redraw();
+    assert(view.frame(video.data()) == "\x1b[?25l\x1b[H\x1b[2J\x1b[1;320H\u2880");
+
+    TerminalView half(CellLayout{CellMode::HALF_BLOCK, 1});
+    video[40 * 3 + 39] = 0;
+    video[40 * 1] = 0x8000; // the second pixel row: the lower half of the first cell
+    video[40 * 2] = 0x4000; // the next row of cells, upper half of its second cell
+    video[40 * 3] = 0x4000;
+    assert(half.frame(video.data()) == "\x1b[?25l\x1b[H\x1b[2J\x1b[1;1H\u2584\x1b[2;2H\u2588");
+    assert(half.restore() == "\x1b[241;1H\x1b[?25h");
+
+    Machine machine;
+    assert(machine.load_memory(image));
+    run_session(machine, "1 2 + .");
+    TerminalView screen;
+    assert(screen.frame(&machine.memory[VIDEO_MEMORY_START]).size() > 100);
+    assert(screen.frame(&machine.memory[VIDEO_MEMORY_START]).empty());
+    std::cout << "Viewer test passed." << std::endl;
+}
+
+// Every microbenchmark must run and report; the filter must pick by name.
+void test_microbench(const std::string &image)
+{
+    std::vector<Microbenchmark> benchmarks = microbenchmarks(image);
+    assert(benchmarks.size() == 31);
+    std::vector<MicrobenchResult> results = run_microbenchmarks(benchmarks, "", 0.0001, 2);
+    assert(results.size() == benchmarks.size());
+    for (const MicrobenchResult &result : results)
+    {
+        assert(result.iterations > 0 && result.items > 0 && result.seconds.size() == 2);
+    }
+    results = run_microbenchmarks(benchmarks, "decode/", 0.0001, 1);
+    assert(results.size() == 16 && results[15].name == "decode/MAJ");
+    std::string json = microbench_json(0.0001, 1, results);
+    assert(json.find("{\"name\": \"decode/LOD\", \"iterations\": ") != std::string::npos);
+    std::cout << "Microbench test passed." << std::endl;
+}
+
+#ifdef SVEU16_WORD_CYCLES
+// The cycles of a colon word must be those from its dispatch (inline at the end of the
+// caller's LIST1 here) to the NEXT1 after its EXIT, as counted by stepping a machine without
+// the accounting hooks; run from EXECUTE the dispatch is EXECUTE's.
+void test_word_cycles(const std::string &image)
+{
+    Machine machine;
+    assert(machine.load_memory(image));
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+    install_native_words(machine, symbols, native_words());
+    run_session(machine, "DECIMAL : BUSY 300 BEGIN 1 - DUP 0= UNTIL DROP ;\n: TWICE BUSY ['] BUSY EXECUTE ;");
+    uint16_t busy = resolve_word(machine, symbols, "BUSY", "");
+    uint16_t twice = resolve_word(machine, symbols, "TWICE", "");
+    uint16_t list1 = machine.memory[busy];
+    Machine reference = machine;
+
+    WordCycles counted;
+    assert(counted.attach(machine));
+    run_session(machine, "TWICE");
+    counted.finish(machine);
+
+    reference.type("TWICE\r");
+    while (!(reference.registers[PC] == list1 && reference.registers[5] == twice))
+    {
+        reference.step();
+    }
+    uint64_t start = reference.cycles + 3; // BUSY is dispatched inline after the push
+    uint16_t rp = reference.registers[3] - 1;
+    do
+    {
+        reference.step();
+    } while (!(reference.registers[PC] == list1 - 3 && reference.registers[3] >= rp));
+    uint64_t cycles = reference.cycles - start;
+
+    const WordCycles::Totals &totals = counted.totals(busy);
+    assert(totals.calls == 2);
+    assert(totals.exclusive == 6 + 3); // dispatch and push, push only from EXECUTE
+    assert(totals.inclusive == 2 * cycles - 3);
+    assert(counted.totals(twice).calls == 1 && counted.totals(twice).exclusive == 3); // from the interpreter's EXECUTE
+    assert(counted.totals(resolve_word(machine, symbols, "0=", "ZEQ")).calls >= 600);
+    std::string csv = counted.csv(machine, symbols);
+    assert(csv.rfind("word,cfa,calls,inclusive,exclusive\n", 0) == 0);
+    assert(csv.find("\"BUSY\",") != std::string::npos);
+    std::cout << "Word cycles test passed." << std::endl;
+}
+#endif
+
+// A GDB session over a socket pair, all packets sent up front: registers and memory, a
+// breakpoint on NEXT1, a step, a write watchpoint on the next data stack cell, Ctrl-C, a
+// reverse step and a reverse continue back to the start of the history.
+void test_gdb_stub(const std::string &image)
+{
+    Machine machine;
+    assert(machine.load_memory(image));
+    run_until_idle(machine);
+    uint16_t next1 = machine.memory[resolve_word(machine, {}, "PAUSE", "PAUS")] - 3;
+    uint16_t push = machine.registers[2] - 1;
+    uint16_t r5 = machine.registers[5];
+
+    auto packet = [](const std::string &payload) {
+        unsigned sum = 0;
+        for (char c : payload)
+        {
+            sum += static_cast<uint8_t>(c);
+        }
+        char checksum[4];
+        std::snprintf(checksum, sizeof(checksum), "#%02x", sum & 0xFF);
+        return "$" + payload + checksum;
+    };
+    auto hex = [](uint32_t value) {
+        char text[8];
+        std::snprintf(text, sizeof(text), "%x", value);
+        return std::string(text);
+    };
+    std::string session;
+    for (const std::string &payload :
+         {std::string("qSupported:swbreak+;xmlRegisters=i386"), std::string("g"), std::string("P5=3412"),
+          std::string("p5"), std::string("M9000,2:cdab3412"), std::string("m9000,2"), "Z0," + hex(next1) + ",1",
+          std::string("c"), std::string("s"), "z0," + hex(next1) + ",1", "Z2," + hex(push) + ",1", std::string("c"),
+          "z2," + hex(push) + ",1", std::string("c")})
+    {
+        session += packet(payload);
+    }
+    session += "\x03" + packet("bs") + packet("bc") + packet("qXfer:features:read:target.xml:0,40") + "$D#00" +
+               packet("D");
+
+    // the stub's output for session, and the replies in it
+    std::string output;
+    auto converse = [&](GdbStub &stub, const std::string &session) {
+        int fds[2];
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        assert(write(fds[1], session.data(), session.size()) == static_cast<ssize_t>(session.size()));
+        assert(stub.serve(fds[0]));
+        close(fds[0]);
+        output.clear();
+        char buffer[4096];
+        for (ssize_t length; (length = read(fds[1], buffer, sizeof(buffer))) > 0;)
+        {
+            output.append(buffer, static_cast<size_t>(length));
+        }
+        close(fds[1]);
+        std::vector<std::string> replies;
+        for (size_t at = output.find('$'); at != std::string::npos; at = output.find('$', at + 1))
+        {
+            replies.push_back(output.substr(at + 1, output.find('#', at) - at - 1));
+        }
+        return replies;
+    };
+    History history;
+    GdbStub stub(machine, &history);
+    std::vector<std::string> replies = converse(stub, session);
+    assert(replies.size() == 18);
+    assert(replies[0].find("PacketSize=") == 0);
+    assert(replies[1].size() == 64 && replies[1].substr(20, 4) == gdb_detail::hex_word(r5));
+    assert(replies[2] == "OK" && replies[3] == "3412");
+    assert(replies[4] == "OK" && replies[5] == "cdab3412");
+    assert(machine.memory[0x9000] == 0xABCD && machine.memory[0x9001] == 0x1234);
+    assert(replies[6] == "OK" && replies[7] == "T05swbreak:;");
+    assert(replies[8] == "T05" && replies[9] == "OK" && replies[10] == "OK");
+    assert(replies[11] == "T05watch:" + hex(push) + ";");
+    assert(replies[12] == "OK" && replies[13] == "S02");
+    assert(replies[14] == "T05" && replies[15] == "T05replaylog:begin;");
+    assert(replies[16].rfind("m<?xml", 0) == 0 && replies[16].size() == 0x41);
+    assert(replies[17] == "OK" && output.find("-+$OK") != std::string::npos); // bad checksum refused
+    assert(!machine.breakpoint(next1));
+
+    // Writes that are not valid change nothing, not even the history, and ranges that wrap
+    // past the end of memory are refused; removing a write watchpoint leaves a read
+    // watchpoint on the same word.
+    machine.registers[5] = r5;
+    session.clear();
+    for (const std::string &payload :
+         {std::string("s"), std::string("P5=34zz"), std::string("P5=341234"), std::string("M9000,2:0100zz00"),
+          std::string("mffffffff,2"), std::string("Mffffffff,2:cdab3412"), std::string("p5"),
+          std::string("m9000,2"), std::string("bs"), "Z3," + hex(push) + ",1",
+          "Z2," + hex(push) + ",1", "z2," + hex(push) + ",1", std::string("c")})
+    {
+        session += packet(payload);
+    }
+    session += "\x03" + packet("z3," + hex(push) + ",1") + packet("D"); // the stop again, once stopped
+    replies = converse(stub, session);
+    assert(replies.size() == 16);
+    assert(replies[0] == "T05" && replies[1] == "E01" && replies[2] == "E01" && replies[3] == "E01");
+    assert(replies[4] == "E01" && replies[5] == "E01");
+    assert(replies[6] == gdb_detail::hex_word(r5) && replies[7] == "cdab3412");
+    assert(replies[8] == "T05"); // not back at the start of the history
+    assert(replies[9] == "OK" && replies[10] == "OK" && replies[11] == "OK");
+    assert(replies[12] == "T05rwatch:" + hex(push) + ";" && replies[13] == replies[12] && replies[14] == "OK");
+    std::cout << "GDB stub test passed." << std::endl;
+}
+
+// Going back must reach the state a plain run has at the same cycle: one step back, back
+// to the last time a breakpoint was passed, and back to the start of a history kept short by
+// its budget. Running forward again must end where the first run did.
+void test_history(const std::string &image)
+{
+    Machine start;
+    assert(start.load_memory(image));
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+    install_drawchar_hooks(start, symbols);
+    install_native_words(start, symbols, native_words());
+    run_until_idle(start);
+    uint16_t next1 = start.memory[resolve_word(start, symbols, "PAUSE", "PAUS")] - 3;
+
+    Machine machine = start;
+    const size_t budget = 400 << 10; // the three images and 32 pages
+    History history(budget, 100000);
+    history.start(machine);
+    history.run(machine, 200000);
+    uint64_t typed = machine.cycles;
+    history.type(machine, "WORDS\r");
+    history.run(machine, 3000000);
+    Machine end = machine;
+    assert(history.checkpoint_count() > 2 && history.memory_used() <= budget);
+    assert(history.oldest() > typed); // the budget has dropped the first checkpoints
+
+    // a plain run to cycle, typing as the history did
+    auto reference = [&](uint64_t cycle) {
+        Machine plain = start;
+        plain.run(typed - plain.cycles);
+        plain.type("WORDS\r");
+        plain.run(cycle - plain.cycles);
+        assert(plain.cycles == cycle);
+        return plain;
+    };
+
+    assert(history.reverse_step(machine));
+    assert(machine.cycles < end.cycles && same_state(machine, reference(machine.cycles)));
+    machine.set_breakpoint(next1, true);
+    assert(history.reverse_continue(machine));
+    assert(machine.stop.reason == StopReason::BREAKPOINT && machine.registers[PC] == next1);
+    assert(same_state(machine, reference(machine.cycles)));
+    machine.set_breakpoint(next1, false);
+
+    machine.stop = Stop();
+    history.run(machine, end.cycles - machine.cycles);
+    assert(same_state(machine, end));
+    assert(!history.reverse_continue(machine));
+    assert(machine.cycles == history.oldest() && same_state(machine, reference(machine.cycles)));
+    assert(!history.reverse_step(machine));
+    history.run(machine, end.cycles - machine.cycles);
+    assert(same_state(machine, end));
+    std::cout << "History test passed." << std::endl;
+}
+
+// PAUSE as ?KEY calls it, switching back to the operator task, to another task, and past
+// sleeping tasks: task rings built in memory next to the operator's user area.
+void test_pause(const std::string &image)
+{
+    Machine base;
+    assert(base.load_memory(image));
+    run_until_idle(base);
+    uint16_t cfa = resolve_word(base, {}, "PAUSE", "PAUS");
+    uint16_t list1 = base.memory[cfa];
+    while (!(base.registers[PC] == list1 && base.registers[5] == cfa))
+    {
+        base.step();
+    }
+    uint16_t wake = resolve_word(base, {}, "_WAKE", "UWAKE");
+    uint16_t pass = resolve_word(base, {}, "_PASS", "UPASS");
+    uint16_t up = base.memory[resolve_word(base, {}, "UP", "UP") + 2];
+    uint16_t next1 = list1 - 3;
+
+    for (int sleeping : {0, 1, 3, 40})
+    {
+        for (bool other : {false, true})
+        {
+            Machine interpreted = base;
+            uint16_t *memory = interpreted.memory.data();
+            uint16_t last = up;
+            for (int i = 0; i < sleeping; ++i)
+            {
+                uint16_t status = 0x9000 + 4 * i;
+                memory[status] = pass;
+                memory[last] = status;
+                last = status + 1;
+            }
+            uint16_t rp = interpreted.registers[3]; // return stack pointer after the switch
+            uint16_t ip = interpreted.registers[4];
+            if (other)
+            {
+                // awake task with its user area at $90FE..$9101, stacks at $9200 and $9300
+                memory[0x9100] = wake;
+                memory[last] = 0x9100;
+                last = 0x9101;
+                memory[0x90FF] = 0x9200;
+                memory[0x9200] = 0x9300;
+                memory[0x9300] = 0x1234;
+                rp = 0x9301;
+                ip = 0x1234;
+            }
+            memory[last] = up - 1;
+            Machine native = interpreted;
+
+            do
+            {
+                interpreted.step();
+            } while (!(interpreted.registers[PC] == next1 && interpreted.registers[3] == rp &&
+                       interpreted.registers[4] == ip));
+            assert(install_native_words(native, {}, native_words()).size() == 5);
+            native.step();
+            assert(native.registers[PC] == next1);
+            assert(same_state(interpreted, native));
+        }
+    }
+    std::cout << "PAUSE test passed." << std::endl;
+}
+
+// A whole session with and without the hooks must end in the same machine state. The hooked
+// run decides when each line is typed; the interpreted run types it at the same cycle.
+void compare_session(const std::string &image, const std::vector<std::string> &lines)
+{
+    Machine native;
+    assert(native.load_memory(image));
+    Machine interpreted = native;
+    std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+    assert(install_drawchar_hooks(native, symbols));
+    install_native_words(native, symbols, native_words());
+
+    std::vector<uint64_t> typed_at;
+    run_until_idle(native);
+    for (const std::string &line : lines)
+    {
+        typed_at.push_back(native.cycles);
+        native.type(line + "\r");
+        run_until_idle(native);
+    }
+
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        interpreted.run(typed_at[i] - interpreted.cycles);
+        interpreted.type(lines[i] + "\r");
+    }
+    interpreted.run(native.cycles - interpreted.cycles);
+    assert(same_state(interpreted, native));
+}
+
+void test_drawchar_session(const std::string &image)
+{
+    compare_session(image, std::vector<std::string>(70, "WORDS"));
+    std::cout << "DRAWCHAR session test passed." << std::endl;
+}
+
+void test_native_words_session(const std::string &image)
+{
+    compare_session(image, {"DECIMAL HERE 100 + 50 7 FILL", "HERE 100 + HERE 200 + 50 MOVE",
+                            "HERE 200 + HERE 210 + 50 MOVE", "HERE 249 + @ . HERE 150 + @ .",
+                            "-7 2 / . -7 2 MOD . 7 -2 /MOD . . 30000 3 * . -1 U. 1000 1000 UM* . .",
+                            "HEX -1 . 7FFF . -8000 . 1234 5678 * . DECIMAL 10 -7 2 SM/REM . ."});
+    std::cout << "Native word session test passed." << std::endl;
+}
+
+void print_usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " <command> [options]\n";
+    std::cerr << "Commands:\n";
+    std::cerr << "  run [image] [--no-native[=WORD,...]] [--native=WORD,...]\n";
+    std::cerr << "                   Boot the image, type stdin at the prompt, print the screen\n";
+    std::cerr << "  profile [image] [--period=N] [--top=N] [--folded=FILE] [native options]\n";
+    std::cerr << "                   Run as 'run' does, sampling every N cycles (1000), and\n";
+    std::cerr << "                   report where the time went, as folded stacks to FILE\n";
+#ifdef SVEU16_WORD_CYCLES
+    std::cerr << "  run|profile ... --word-cycles=FILE\n";
+    std::cerr << "                   Count the cycles and calls of every Forth word exactly, as CSV\n";
+#endif
+    std::cerr << "  run|profile|gdb|footprint ... --memory=PAGES[+mlock][+prefault]\n";
+    std::cerr << "                   Back guest memory with PAGES: thp (the default), small or\n";
+    std::cerr << "                   hugetlb, locked in RAM and faulted in before the first\n";
+    std::cerr << "                   instruction; run and profile report when that came\n";
+    std::cerr << "  run ... --view[=braille|half] [--scale=N] [--fps=N] [--frames=N]\n";
+    std::cerr << "                   Show the screen live on this terminal, redrawing what changed\n";
+    std::cerr << "                   N (30) times a second, each dot N (2) pixels square, and type\n";
+    std::cerr << "                   the keys pressed (Ctrl-C quits); up to N frames, 0 for any\n";
+    std::cerr << "  run|profile ... --record=FILE\n";
+    std::cerr << "                   Record every key the guest reads and the cycle it reads it at\n";
+    std::cerr << "  run|profile|gdb ... --replay=FILE\n";
+    std::cerr << "                   Give the guest the recorded keys instead of stdin and run to\n";
+    std::cerr << "                   where the recording ended, checking that it ends the same\n";
+    std::cerr << "  gdb [image] [--port=N | --socket=PATH] [--history=MB] [native options]\n";
+    std::cerr << "                   Boot the image and serve GDB on 127.0.0.1:N (1234) or a Unix\n";
+    std::cerr << "                   socket, then print the screen; reverse execution keeps up to\n";
+    std::cerr << "                   MB (64, 0 for none) of checkpoints\n";
+    std::cerr << "  bench [image] [--repeat=N] [native options]\n";
+    std::cerr << "                   Time the Forth workloads N times (10) and print the cycles,\n";
+    std::cerr << "                   cycles per word, wall time and MIPS as JSON\n";
+    std::cerr << "  microbench [image] [--filter=TEXT] [--min-time=S] [--repeat=N]\n";
+    std::cerr << "                   Time the emulator's hot paths whose names contain TEXT, N (10)\n";
+    std::cerr << "                   times S seconds (0.02) each, and print the rates as JSON\n";
+    std::cerr << "  footprint [image] [--machines=N]\n";
+    std::cerr << "                   Load the image into N (256) machines on the heap and in a\n";
+    std::cerr << "                   machine pool and print the memory each takes as JSON\n";
+    std::cerr << "  test [image]     Run all tests\n";
+    std::cerr << "  asm [source [image [table]]]\n";
+    std::cerr << "                   Assemble forth.asm into forth.mem and table.txt, reusing what\n";
+    std::cerr << "                   has not changed since the last time from forth.asm.cache\n";
+    std::cerr << "  pack [image [table [container]]]\n";
+    std::cerr << "                   Write the image and table.txt into one checksummed container\n";
+    std::cerr << "                   (forth.img), which every command loads as it does forth.mem\n";
+    std::cerr << "  export [image] file [--byte-order=little|big]\n";
+    std::cerr << "                   Write the image as Intel HEX (file.hex), a container (file.img)\n";
+    std::cerr << "                   or raw, each word's bytes in the byte order given (little)\n";
+    std::cerr << "  run|profile|gdb|export|disasm|dump ... --input-order=little|big\n";
+    std::cerr << "                   Read a raw or Intel HEX image's words in that byte order\n";
+    std::cerr << "  disasm [image] [--from=HEX] [--to=HEX]\n";
+    std::cerr << "                   List the image as source, labelled from table.txt\n";
+    std::cerr << "  dump [image] [--from=HEX] [--to=HEX]\n";
+    std::cerr << "                   Hex dump of the image\n";
+    std::cerr << "Native words: DRAWCHAR SCROLL";
+    for (const NativeWord &word : native_words())
+    {
+        std::cerr << " " << word.name << (word.enabled ? "" : " (off, cycles not exact)");
+    }
+    std::cerr << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    auto started = std::chrono::steady_clock::now();
+    if (argc < 2)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string command = argv[1];
+    std::string image = "forth.mem";
+    std::vector<std::string> files;
+    uint32_t from = 0;
+    uint32_t to = 0x10000;
+    uint64_t period = 1000;
+    size_t top = 20;
+    size_t repeat = 10;
+    size_t machines = 256;
+    bool viewed = false;
+    CellLayout cell_layout;
+    double fps = 30;
+    uint64_t frames = 0;
+    MemoryPolicy memory_policy;
+    ByteOrder input_order = ByteOrder::LITTLE;
+    ByteOrder byte_order = ByteOrder::LITTLE;
+    std::string filter;
+    double min_time = 0.02;
+    std::string folded;
+    std::string word_cycles;
+    uint16_t port = 1234;
+    std::string socket_path;
+    size_t history_mb = 64;
+    std::string record_file;
+    std::string replay_file;
+    bool drawchar = true;
+    bool scroll = true;
+    std::vector<NativeWord> words = native_words();
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--no-native")
+        {
+            drawchar = scroll = false;
+            for (NativeWord &word : words)
+            {
+                word.enabled = false;
+            }
+        }
+        else if (arg.rfind("--no-native=", 0) == 0 || arg.rfind("--native=", 0) == 0)
+        {
+            bool enable = arg[2] == 'n' && arg[3] == 'a';
+            std::stringstream names(arg.substr(arg.find('=') + 1));
+            std::string name;
+            while (std::getline(names, name, ','))
+            {
+                if (name == "DRAWCHAR")
+                {
+                    drawchar = enable;
+                }
+                else if (name == "SCROLL")
+                {
+                    scroll = enable;
+                }
+                else if (!set_native_word(words, name, enable))
+                {
+                    std::cerr << "Unknown native word: " << name << std::endl;
+                    return 1;
+                }
+            }
+        }
+        else if (arg.rfind("--period=", 0) == 0)
+        {
+            period = std::max<uint64_t>(std::stoull(arg.substr(arg.find('=') + 1)), 1);
+        }
+        else if (arg.rfind("--repeat=", 0) == 0)
+        {
+            repeat = std::max<size_t>(std::stoull(arg.substr(arg.find('=') + 1)), 1);
+        }
+        else if (arg.rfind("--memory=", 0) == 0)
+        {
+            if (!memory_policy.parse(arg.substr(arg.find('=') + 1)))
+            {
+                std::cerr << "Unknown memory policy: " << arg.substr(arg.find('=') + 1) << std::endl;
+                return 1;
+            }
+        }
+        else if (arg.rfind("--input-order=", 0) == 0 || arg.rfind("--byte-order=", 0) == 0)
+        {
+            std::string order = arg.substr(arg.find('=') + 1);
+            if (order != "little" && order != "big")
+            {
+                std::cerr << "Byte order must be little or big, not " << order << std::endl;
+                return 1;
+            }
+            (arg[2] == 'i' ? input_order : byte_order) = order == "big" ? ByteOrder::BIG : ByteOrder::LITTLE;
+        }
+        else if (arg.rfind("--view", 0) == 0)
+        {
+            std::string cells = arg.size() > 6 && arg[6] == '=' ? arg.substr(7) : "braille";
+            if (cells != "braille" && cells != "half")
+            {
+                std::cerr << "--view takes braille or half, not " << cells << std::endl;
+                return 1;
+            }
+            viewed = true;
+            cell_layout.mode = cells == "half" ? CellMode::HALF_BLOCK : CellMode::BRAILLE;
+        }
+        else if (arg.rfind("--scale=", 0) == 0)
+        {
+            cell_layout.scale = std::stoi(arg.substr(arg.find('=') + 1));
+            if (cell_layout.scale != 1 && cell_layout.scale != 2 && cell_layout.scale != 4)
+            {
+                std::cerr << "--scale must be 1, 2 or 4" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg.rfind("--fps=", 0) == 0)
+        {
+            fps = std::max(std::stod(arg.substr(arg.find('=') + 1)), 1.0);
+        }
+        else if (arg.rfind("--frames=", 0) == 0)
+        {
+            frames = std::stoull(arg.substr(arg.find('=') + 1));
+        }
+        else if (arg.rfind("--machines=", 0) == 0)
+        {
+            machines = std::max<size_t>(std::stoull(arg.substr(arg.find('=') + 1)), 1);
+        }
+        else if (arg.rfind("--filter=", 0) == 0)
+        {
+            filter = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg.rfind("--min-time=", 0) == 0)
+        {
+            min_time = std::stod(arg.substr(arg.find('=') + 1));
+        }
+        else if (arg.rfind("--top=", 0) == 0)
+        {
+            top = std::stoull(arg.substr(arg.find('=') + 1));
+        }
+        else if (arg.rfind("--folded=", 0) == 0)
+        {
+            folded = arg.substr(arg.find('=') + 1);
+        }
+#ifdef SVEU16_WORD_CYCLES
+        else if (arg.rfind("--word-cycles=", 0) == 0)
+        {
+            word_cycles = arg.substr(arg.find('=') + 1);
+        }
+#endif
+        else if (arg.rfind("--port=", 0) == 0)
+        {
+            port = static_cast<uint16_t>(std::stoul(arg.substr(arg.find('=') + 1)));
+        }
+        else if (arg.rfind("--history=", 0) == 0)
+        {
+            history_mb = std::stoul(arg.substr(arg.find('=') + 1));
+        }
+        else if (arg.rfind("--socket=", 0) == 0)
+        {
+            socket_path = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg.rfind("--record=", 0) == 0)
+        {
+            record_file = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg.rfind("--replay=", 0) == 0)
+        {
+            replay_file = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg.rfind("--from=", 0) == 0 || arg.rfind("--to=", 0) == 0)
+        {
+            uint32_t &bound = arg[2] == 'f' ? from : to;
+            bound = static_cast<uint32_t>(std::stoul(arg.substr(arg.find('=') + 1), nullptr, 16));
+        }
+        else
+        {
+            files.push_back(arg);
+        }
+    }
+    if (command != "asm" && !files.empty())
+    {
+        image = files[0];
+    }
+
+    if (command == "run" || command == "profile" || command == "gdb")
+    {
+        MachinePool pool(1, memory_policy);
+        if (pool.capacity == 0)
+        {
+            std::cerr << "Failed to map guest memory: " << pool.error << std::endl;
+            return 1;
+        }
+        Machine &machine = *pool.acquire();
+        ImageInfo info;
+        std::string error;
+        auto loading = std::chrono::steady_clock::now();
+        if (!machine.load_memory(image, info, error, input_order))
+        {
+            std::cerr << "Failed to load " << image << ": " << error << std::endl;
+            return 1;
+        }
+        std::chrono::duration<double, std::micro> loaded = std::chrono::steady_clock::now() - loading;
+        std::cerr << "Loaded " << info.words << " words in " << loaded.count() << " us" << std::endl;
+        std::istringstream embedded(info.symbols);
+        std::unordered_map<std::string, uint16_t> symbols =
+            info.symbols.empty() ? load_symbols("table.txt") : parse_symbols(embedded);
+        DrawcharLayout layout;
+        if (!find_drawchar(machine, symbols, layout))
+        {
+            std::cerr << "No DRAWCHAR routine found in " << image << std::endl;
+            return 1;
+        }
+        install_drawchar_hooks(machine, symbols, drawchar, scroll);
+        install_native_words(machine, symbols, words);
+
+        if (viewed && (command != "run" || !replay_file.empty()))
+        {
+            std::cerr << "--view goes with run, without --replay" << std::endl;
+            return 1;
+        }
+        Recording recording;
+        if (!record_file.empty() && (command == "gdb" || !replay_file.empty()))
+        {
+            std::cerr << "--record goes with run or profile, without --replay" << std::endl;
+            return 1;
+        }
+        if (!replay_file.empty())
+        {
+            std::ifstream file(replay_file, std::ios::binary);
+            if (!file.is_open() || !read_recording(file, recording))
+            {
+                std::cerr << "Failed to read recording from file: " << replay_file << std::endl;
+                return 1;
+            }
+            if (recording.image_hash != image_hash(machine))
+            {
+                std::cerr << replay_file << " was recorded from another image than " << image << std::endl;
+                return 1;
+            }
+            machine.input_replay = &recording.events;
+        }
+        else if (!record_file.empty())
+        {
+            recording.image_hash = image_hash(machine);
+            machine.input_log = &recording.events;
+        }
+
+        Profiler profiler(find_rp0(machine, symbols));
+        if (command == "profile")
+        {
+            profiler.attach(machine, period);
+        }
+#ifdef SVEU16_WORD_CYCLES
+        WordCycles counted;
+        if (!word_cycles.empty() && !counted.attach(machine))
+        {
+            std::cerr << "No colon words found in " << image << std::endl;
+            return 1;
+        }
+#endif
+
+        machine.skip_idle = command != "gdb" && word_cycles.empty();
+        if (command != "gdb")
+        {
+            machine.step();
+            std::chrono::duration<double, std::micro> first = std::chrono::steady_clock::now() - started;
+            std::cerr << "First instruction " << first.count() << " us after start" << std::endl;
+        }
+
+        if (command == "gdb")
+        {
+            int listener = socket_path.empty() ? gdb_listen_tcp(port, error) : gdb_listen_unix(socket_path, error);
+            if (listener < 0)
+            {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+            std::cerr << "Waiting for GDB on " << (socket_path.empty() ? "127.0.0.1:" + std::to_string(port) : socket_path)
+                      << std::endl;
+            int client = accept(listener, nullptr, nullptr);
+            close(listener);
+            History history(history_mb << 20);
+            if (client < 0 || !GdbStub(machine, history_mb > 0 ? &history : nullptr).serve(client))
+            {
+                std::cerr << "GDB connection lost" << std::endl;
+            }
+            if (client >= 0)
+            {
+                close(client);
+            }
+        }
+        else if (!replay_file.empty())
+        {
+            auto begin = std::chrono::steady_clock::now();
+            machine.run(recording.end_cycle - machine.cycles);
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+            std::cerr << "Replayed in " << seconds.count() << " s" << std::endl;
+        }
+        else if (viewed)
+        {
+            TerminalView view(cell_layout);
+            ViewStats stats = view_session(machine, view, fps, frames);
+            std::cerr << stats.frames << " frames, " << stats.bytes / std::max<uint64_t>(stats.frames, 1)
+                      << " bytes and " << stats.seconds * 1e6 / std::max<uint64_t>(stats.frames, 1)
+                      << " us to build each" << std::endl;
+        }
+        else
+        {
+            std::stringstream input;
+            input << std::cin.rdbuf();
+            run_session(machine, input.str());
+        }
+        if (!viewed)
+        {
+            std::cout << screen_text(machine, layout.font);
+        }
+        std::cerr << machine.cycles << " cycles";
+        if (machine.skipped_cycles > 0)
+        {
+            std::cerr << " (" << machine.skipped_cycles << " waiting for keys, skipped)";
+        }
+        std::cerr << std::endl;
+        if (machine.input_log)
+        {
+            recording.end_cycle = machine.cycles;
+            recording.end_hash = state_hash(machine);
+            std::ofstream file(record_file, std::ios::binary);
+            write_recording(file, recording);
+            if (!file)
+            {
+                std::cerr << "Failed to write " << record_file << std::endl;
+                return 1;
+            }
+            std::cerr << recording.events.size() << " keys recorded" << std::endl;
+        }
+        if (!replay_file.empty() && command != "gdb" &&
+            (machine.input_replayed != recording.events.size() || state_hash(machine) != recording.end_hash))
+        {
+            std::cerr << "The replay did not end as the recording did, after " << machine.input_replayed << " of "
+                      << recording.events.size() << " keys" << std::endl;
+            return 1;
+        }
+        if (command == "profile")
+        {
+            std::cerr << profiler.report(machine, symbols, top);
+            if (!folded.empty() && !(std::ofstream(folded) << profiler.folded(machine, symbols)))
+            {
+                std::cerr << "Failed to write " << folded << std::endl;
+                return 1;
+            }
+        }
+#ifdef SVEU16_WORD_CYCLES
+        counted.finish(machine);
+        if (!word_cycles.empty() && !(std::ofstream(word_cycles) << counted.csv(machine, symbols)))
+        {
+            std::cerr << "Failed to write " << word_cycles << std::endl;
+            return 1;
+        }
+#endif
+    }
+    else if (command == "bench")
+    {
+        Machine machine;
+        if (!machine.load_memory(image))
+        {
+            std::cerr << "Failed to load memory from file: " << image << std::endl;
+            return 1;
+        }
+        std::unordered_map<std::string, uint16_t> symbols = load_symbols("table.txt");
+        install_drawchar_hooks(machine, symbols, drawchar, scroll);
+        install_native_words(machine, symbols, words);
+        run_until_idle(machine);
+        std::vector<BenchResult> results;
+        std::string error;
+        if (!run_bench(machine, bench_workloads(), repeat, results, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << bench_json(image, repeat, results);
+    }
+    else if (command == "microbench")
+    {
+        std::cout << microbench_json(min_time, repeat,
+                                     run_microbenchmarks(microbenchmarks(image), filter, min_time, repeat));
+    }
+    else if (command == "footprint")
+    {
+        if (!Machine().load_memory(image))
+        {
+            std::cerr << "Failed to load memory from file: " << image << std::endl;
+            return 1;
+        }
+        std::cout << footprint_json(image, machines, memory_policy);
+    }
+    else if (command == "test")
+    {
+        test_instructions();
+        test_assembler("forth.asm", image);
+        test_disassembler(image);
+        test_boot(image);
+        test_drawchar_hook(image);
+        test_native_words(image);
+        test_drawchar_session(image);
+        test_native_words_session(image);
+        test_sfind(image);
+        test_pause(image);
+        test_sfind_session(image);
+        test_profiler(image);
+        test_gdb_stub(image);
+        test_history(image);
+        test_recording(image);
+        test_skip_idle(image);
+        test_bench(image);
+        test_microbench(image);
+        test_embedding(image);
+        test_call_word(image);
+        test_scheduler(image);
+        test_machine_pool(image);
+        test_image(image);
+        test_image_formats(image);
+        test_viewer(image);
+#ifdef SVEU16_WORD_CYCLES
+        test_word_cycles(image);
+#endif
+        std::cout << "All tests passed!" << std::endl;
+    }
+    else if (command == "asm")
+    {
+        std::string source = files.size() > 0 ? files[0] : "forth.asm";
+        image = files.size() > 1 ? files[1] : image;
+        std::string table = files.size() > 2 ? files[2] : "table.txt";
+        std::ifstream file(source, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cerr << "Failed to read source file: " << source << std::endl;
+            return 1;
+        }
+        Assembler assembler;
+        std::ifstream cached(source + ".cache", std::ios::binary);
+        assembler.read_cache(cached);
+        Assembly assembly;
+        std::string error;
+        if (!assembler.assemble(read_text(source), assembly, error))
+        {
+            std::cerr << source << ": " << error << std::endl;
+            return 1;
+        }
+        std::ofstream cache(source + ".cache", std::ios::binary);
+        assembler.write_cache(cache);
+        std::ofstream symbols(table);
+        symbols << symbol_table(assembly);
+        if (!save_image(image, assembly.image) || !symbols)
+        {
+            std::cerr << "Failed to write " << image << " or " << table << std::endl;
+            return 1;
+        }
+        std::cerr << assembly.image.size() << " words, " << assembly.symbols.size() << " symbols, "
+                  << assembler.parsed_sections() << " sections parsed" << std::endl;
+    }
+    else if (command == "pack")
+    {
+        image = files.size() > 0 ? files[0] : image;
+        std::string table = files.size() > 1 ? files[1] : "table.txt";
+        std::string packed = files.size() > 2 ? files[2] : image.substr(0, image.rfind('.')) + ".img";
+        std::vector<uint16_t> words(MEMORY_WORDS);
+        ImageInfo info;
+        std::string error;
+        if (!read_image(image, words.data(), info, error, input_order))
+        {
+            std::cerr << "Failed to load " << image << ": " << error << std::endl;
+            return 1;
+        }
+        words.erase(words.begin(), words.begin() + info.load_address);
+        words.resize(info.words);
+        std::string symbols = info.symbols.empty() ? read_text(table) : info.symbols;
+        std::ofstream file(packed, std::ios::binary);
+        file << container_image(words, info.load_address, info.entry, symbols);
+        if (!file)
+        {
+            std::cerr << "Failed to write " << packed << std::endl;
+            return 1;
+        }
+        std::cerr << info.words << " words and " << symbols.size() << " bytes of symbols in " << packed << std::endl;
+    }
+    else if (command == "export")
+    {
+        if (files.empty())
+        {
+            std::cerr << "export needs a file to write" << std::endl;
+            return 1;
+        }
+        std::string exported = files.back();
+        image = files.size() > 1 ? files[0] : "forth.mem";
+        std::vector<uint16_t> memory(MEMORY_WORDS);
+        ImageInfo info;
+        std::string error;
+        if (!read_image(image, memory.data(), info, error, input_order))
+        {
+            std::cerr << "Failed to load " << image << ": " << error << std::endl;
+            return 1;
+        }
+        auto ends_with = [&exported](const std::string &suffix) {
+            return exported.size() > suffix.size() &&
+                   exported.compare(exported.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+        const uint16_t *words = memory.data() + info.load_address;
+        std::ofstream file(exported, std::ios::binary);
+        if (ends_with(".hex"))
+        {
+            file << intel_hex(words, info.words, info.load_address, byte_order);
+        }
+        else if (ends_with(".img"))
+        {
+            std::string symbols = info.symbols.empty() ? read_text("table.txt") : info.symbols;
+            file << container_image(std::vector<uint16_t>(words, words + info.words), info.load_address, info.entry,
+                                    symbols);
+        }
+        else
+        {
+            file << raw_image(memory.data(), info.load_address + info.words, byte_order);
+        }
+        if (!file)
+        {
+            std::cerr << "Failed to write " << exported << std::endl;
+            return 1;
+        }
+    }
+    else if (command == "disasm" || command == "dump")
+    {
+        Machine machine;
+        ImageInfo info;
+        std::string error;
+        if (!machine.load_memory(image, info, error, input_order))
+        {
+            std::cerr << "Failed to load " << image << ": " << error << std::endl;
+            return 1;
+        }
+        if (command == "dump")
+        {
+            std::cout << dump_memory(machine.memory, from, to);
+        }
+        else
+        {
+            std::unordered_map<uint16_t, std::string> labels = load_address_labels("table.txt");
+            std::cout << Disassembler(machine.memory, labels).listing(from, to);
+        }
+    }
+    else
+    {
+        std::cerr << "Unknown command: " << command << "\n";
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    return 0;
+}
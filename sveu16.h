@@ -0,0 +1,704 @@
+// Headless SVEU16 machine: the CPU that forth.asm / forth.mem is written for.
+//
+// Instruction word: oooo dddd aaaa bbbb
+//   LOD Rd,Ra,Rb   Rd = mem[Rb]   (when Rb is R15 the word after the instruction
+//                                  is read and skipped, so "LOD Rx,Rx,R15 / WRD n"
+//                                  loads the immediate n)
+//   STO Rd,Ra,Rb   mem[Rb] = Rd
+//   MIF Rd,Ra,Rb   if (Ra != 0) Rd = Rb
+//   MAJ Rd,Ra,Rb   Rd = Ra, R15 = Rb   (MAJ R11,R15,Rx is a call, R11 = return address)
+//   SHR Rd,Ra,Rb   Rb bits 0-3 = amount, bits 4-5 = kind (arithmetic right,
+//                  logical right, left, rotate right)
+//   the rest are Rd = Ra op Rb, compares give 1 or 0.
+// R15 is the program counter and already points past the instruction while it executes.
+#pragma once
+
+#include "device.h"
+#include "image.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr uint16_t KEYBOARD_PORT = 0xFFF1; // read: next key or 0 when none is waiting
+constexpr uint16_t CONSOLE_PORT = 0xFFF2;  // write: character sent by TX!
+constexpr uint16_t VIDEO_MEMORY_START = 0xB000;
+constexpr uint16_t VIDEO_MEMORY_WORDS = 640 / 16 * 480; // 640x480, one bit per pixel
+constexpr int PC = 15;
+
+enum Opcode
+{
+    LOD, ADD, SUB, AND, ORA, XOR, SHR, MUL, STO, MIF, GTU, GTS, LTU, LTS, EQU, MAJ
+};
+
+class Machine;
+
+// Runs instead of the guest code at the address it is installed on. It must leave the
+// machine exactly as the guest code would (registers, memory, cycles) or return false,
+// in which case the instruction at that address is interpreted normally.
+using NativeHook = std::function<bool(Machine &)>;
+
+// Why run() or run_until() returned before its budget: a breakpoint at the program counter
+// (not executed yet) or a watched address that the last instruction stored to or read.
+enum class StopReason : uint8_t
+{
+    NONE,
+    BREAKPOINT,
+    WATCH_WRITE,
+    WATCH_READ
+};
+
+struct Stop
+{
+    StopReason reason = StopReason::NONE;
+    uint16_t address = 0;
+};
+
+// A key the guest read from KEYBOARD_PORT and the cycle it read it at.
+struct InputEvent
+{
+    uint64_t cycle;
+    uint16_t key;
+};
+
+// Guest memory. The machine's large buffers come from the memory resource it is built with,
+// so that a MachinePool (arena.h) can keep a whole machine in one slot of its arena; copies
+// of a machine get theirs from the default resource.
+using Memory = std::pmr::vector<uint16_t>;
+
+class Machine
+{
+public:
+    Memory memory;
+    uint16_t registers[16];
+    uint64_t cycles;
+    std::pmr::deque<uint16_t> keyboard; // keys waiting to be read from KEYBOARD_PORT
+    std::string console;                // everything written to CONSOLE_PORT
+    uint64_t empty_polls;               // keyboard reads that found nothing since the last key or output
+    std::vector<uint16_t> watched_stores; // watched addresses stored to, for whoever watches them to clear
+    Stop stop;                            // set by breakpoints and watchpoints, cleared by whoever set them
+    std::vector<InputEvent> *input_log = nullptr;          // keys read are appended here when set
+    const std::vector<InputEvent> *input_replay = nullptr; // when set, keys come from here, not keyboard
+    size_t input_replayed = 0;                             // events of input_replay read so far
+    // run() skips the rounds of the polling loop eForth waits for a key in: when a keyboard
+    // read finds nothing, the registers are as at the last one and every cell stored to in
+    // between is back as it was (PAUSE's scratch cells), with no output, keys or device
+    // accesses, the guest would go round the same loop until a key came. Whole rounds are
+    // then added to cycles (and empty_polls) instead of run, up to the end of the run, the
+    // next sample or the next replayed key. Not for runs with breakpoints, watchpoints or
+    // hooks that count what runs (WordCycles); a sampler is fine.
+    bool skip_idle = false;
+    uint64_t skipped_cycles = 0; // cycles skip_idle added without running them
+
+    explicit Machine(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : memory(65536, 0, resource), registers{}, cycles(0), keyboard(resource), empty_polls(0),
+          code_flags(65536, 0, resource), watch_flags(65536, 0, resource)
+    {
+        watch_flags[KEYBOARD_PORT] = PORT;
+    }
+
+    // Loads a raw image, a container or Intel HEX (see image.h); a container's entry point
+    // becomes the program counter. A file that is not a valid image leaves the machine as it was.
+    bool load_memory(const std::string &filename, ImageInfo &info, std::string &error,
+                     ByteOrder order = ByteOrder::LITTLE)
+    {
+        if (!read_image(filename, memory.data(), info, error, order))
+        {
+            return false;
+        }
+        if (info.container)
+        {
+            registers[PC] = info.entry;
+        }
+        return true;
+    }
+
+    bool load_memory(const std::string &filename)
+    {
+        ImageInfo info;
+        std::string error;
+        return load_memory(filename, info, error);
+    }
+
+    void reset()
+    {
+        std::fill(std::begin(registers), std::end(registers), 0);
+        cycles = 0;
+        empty_polls = 0;
+        polled = false;
+    }
+
+    // The machine as it was built, keeping its buffers: memory zero, no hooks, breakpoints,
+    // watchpoints, watched addresses, devices, sampler, keys, console output or stop. The
+    // settings (skip_idle, input_log, input_replay) stay.
+    void clear()
+    {
+        std::fill(memory.begin(), memory.end(), 0);
+        std::fill(code_flags.begin(), code_flags.end(), 0);
+        std::fill(watch_flags.begin(), watch_flags.end(), 0);
+        watch_flags[KEYBOARD_PORT] = PORT;
+        watched = 0;
+        watched_stores.clear();
+        hooks.clear();
+        devices.clear();
+        set_sampler(0, nullptr);
+        keyboard.clear();
+        console.clear();
+        stop = Stop();
+        input_replayed = 0;
+        skipped_cycles = 0;
+        round_length = 0;
+        reset();
+    }
+
+    void type(const std::string &text)
+    {
+        for (char c : text)
+        {
+            keyboard.push_back(static_cast<uint8_t>(c));
+        }
+    }
+
+    uint16_t read(uint16_t address)
+    {
+        if (watch_flags[address] & (PORT | READ_WATCH))
+        {
+            return read_flagged(address);
+        }
+        return memory[address];
+    }
+
+    uint16_t read_flagged(uint16_t address)
+    {
+        if (watch_flags[address] & READ_WATCH)
+        {
+            stop_at(StopReason::WATCH_READ, address);
+        }
+        if (address != KEYBOARD_PORT)
+        {
+            auto it = devices.find(address);
+            if (it == devices.end())
+            {
+                return memory[address];
+            }
+            round_length = ROUND_WRITES + 1;
+            return it->second->read(address, cycles);
+        }
+        if (input_replay)
+        {
+            return replay_key();
+        }
+        if (keyboard.empty())
+        {
+            empty_polls++;
+            if (skip_limit != 0)
+            {
+                skip_polling_loop();
+            }
+            return 0;
+        }
+        uint16_t key = keyboard.front();
+        keyboard.pop_front();
+        empty_polls = 0;
+        round_length = ROUND_WRITES + 1;
+        if (input_log)
+        {
+            input_log->push_back({cycles, key});
+        }
+        return key;
+    }
+
+    void write(uint16_t address, uint16_t value)
+    {
+        if (skip_limit != 0)
+        {
+            log_round_write(address);
+        }
+        if (address == CONSOLE_PORT)
+        {
+            console.push_back(static_cast<char>(value));
+            empty_polls = 0;
+            round_length = ROUND_WRITES + 1;
+        }
+        if (watch_flags[address])
+        {
+            if (watch_flags[address] & PORT)
+            {
+                write_port(address, value);
+                round_length = ROUND_WRITES + 1;
+            }
+            stored(address);
+        }
+        memory[address] = value;
+    }
+
+    // Maps device at address (not the keyboard or console port), in place of any there.
+    // The machine does not own it; copies of the machine share it.
+    bool attach_device(uint16_t address, Device &device)
+    {
+        if (address == KEYBOARD_PORT || address == CONSOLE_PORT)
+        {
+            return false;
+        }
+        devices[address] = &device;
+        watch_flags[address] |= PORT;
+        return true;
+    }
+
+    void detach_device(uint16_t address)
+    {
+        if (devices.erase(address))
+        {
+            watch_flags[address] &= ~PORT;
+        }
+    }
+
+    // Stores to a watched address are listed in watched_stores (up to MAX_WATCHED_STORES,
+    // after that the list stays full and only says that too much has changed).
+    static constexpr size_t MAX_WATCHED_STORES = 1024;
+
+    void watch(uint16_t address)
+    {
+        set_watch_flag(address, LISTED, true);
+    }
+
+    // Forgets the addresses watch() was given (not watchpoints).
+    void unwatch_all()
+    {
+        for (uint8_t &flags : watch_flags)
+        {
+            watched -= (flags & (LISTED | WRITE_WATCH)) == LISTED;
+            flags &= ~LISTED;
+        }
+        watched_stores.clear();
+    }
+
+    // Breakpoints stop run() and run_until() before the instruction at address; watchpoints
+    // after an instruction that stores to or reads address (native hooks report their stores
+    // through stored(), not their reads). Either way stop says why; run() and run_until() keep
+    // returning until it is cleared.
+    void set_breakpoint(uint16_t address, bool set)
+    {
+        code_flags[address] = set ? code_flags[address] | BREAKPOINT : code_flags[address] & ~BREAKPOINT;
+    }
+
+    bool breakpoint(uint16_t address) const
+    {
+        return code_flags[address] & BREAKPOINT;
+    }
+
+    void set_watchpoint(uint16_t address, bool write, bool read, bool set)
+    {
+        set_watch_flag(address, WRITE_WATCH, set && write);
+        set_watch_flag(address, READ_WATCH, set && read);
+    }
+
+    // For native hooks that write memory directly instead of through write().
+    void stored(uint16_t address, uint32_t length = 1)
+    {
+        round_length = ROUND_WRITES + 1;
+        if (watched == 0)
+        {
+            return;
+        }
+        for (uint32_t i = address; i < address + length && i < watch_flags.size(); ++i)
+        {
+            if ((watch_flags[i] & LISTED) && watched_stores.size() < MAX_WATCHED_STORES)
+            {
+                watched_stores.push_back(static_cast<uint16_t>(i));
+            }
+            if (watch_flags[i] & WRITE_WATCH)
+            {
+                stop_at(StopReason::WATCH_WRITE, static_cast<uint16_t>(i));
+            }
+        }
+    }
+
+    void step()
+    {
+        uint16_t pc = registers[PC];
+        if (code_flags[pc] && run_flagged(pc))
+        {
+            return;
+        }
+        registers[PC] = pc + 1;
+        cycles++;
+        execute_instruction(memory[pc]);
+    }
+
+    // Executes the instruction at the program counter even when it has a breakpoint.
+    void step_over()
+    {
+        uint16_t pc = registers[PC];
+        uint8_t flags = code_flags[pc];
+        code_flags[pc] &= ~BREAKPOINT;
+        step();
+        code_flags[pc] |= flags & BREAKPOINT;
+    }
+
+    void run(uint64_t count)
+    {
+        uint64_t end = cycles + count;
+        polled = false; // the host may have changed anything since the last run
+        while (cycles < end && stop.reason == StopReason::NONE)
+        {
+            limit = std::min(end, next_sample);
+            skip_limit = skip_idle ? limit : 0;
+            while (cycles < limit)
+            {
+                step();
+            }
+            skip_limit = 0;
+            sample_if_due();
+        }
+    }
+
+    // Runs until the program counter reaches address (or the cycle budget runs out).
+    bool run_until(uint16_t address, uint64_t budget)
+    {
+        uint64_t end = cycles + budget;
+        while (registers[PC] != address)
+        {
+            if (cycles >= end || stop.reason != StopReason::NONE)
+            {
+                return false;
+            }
+            limit = std::min(end, next_sample);
+            while (registers[PC] != address && cycles < limit)
+            {
+                step();
+            }
+            sample_if_due();
+        }
+        return true;
+    }
+
+    // Has run() and run_until() call sampler every period cycles, at the end of the
+    // instruction (or native hook) that reaches the cycle. A period of 0 stops sampling.
+    void set_sampler(uint64_t period, std::function<void(Machine &)> sampler)
+    {
+        sample_period = period;
+        this->sampler = std::move(sampler);
+        next_sample = period == 0 ? UINT64_MAX : cycles + period;
+    }
+
+    void install_hook(uint16_t address, NativeHook hook)
+    {
+        hooks[address] = std::move(hook);
+        code_flags[address] |= HOOK;
+    }
+
+    // The hook installed at address, or an empty one, for whoever installs another to chain to.
+    NativeHook hook(uint16_t address) const
+    {
+        auto it = hooks.find(address);
+        return it != hooks.end() ? it->second : NativeHook();
+    }
+
+    void remove_hook(uint16_t address)
+    {
+        hooks.erase(address);
+        code_flags[address] &= ~HOOK;
+    }
+
+    void remove_hooks()
+    {
+        hooks.clear();
+        for (uint8_t &flags : code_flags)
+        {
+            flags &= ~HOOK;
+        }
+    }
+
+    void execute_instruction(uint16_t instruction)
+    {
+        uint16_t d = (instruction >> 8) & 0x0F;
+        uint16_t x = registers[(instruction >> 4) & 0x0F];
+        uint16_t b = instruction & 0x0F;
+        uint16_t y = registers[b];
+
+        switch (instruction >> 12)
+        {
+        case LOD:
+        {
+            uint16_t value = read(y);
+            if (b == PC)
+            {
+                registers[PC]++; // skip the inline word
+            }
+            registers[d] = value;
+            break;
+        }
+        case ADD:
+            registers[d] = x + y;
+            break;
+        case SUB:
+            registers[d] = x - y;
+            break;
+        case AND:
+            registers[d] = x & y;
+            break;
+        case ORA:
+            registers[d] = x | y;
+            break;
+        case XOR:
+            registers[d] = x ^ y;
+            break;
+        case SHR:
+            registers[d] = shift(x, y);
+            break;
+        case MUL:
+            registers[d] = x * y;
+            break;
+        case STO:
+            write(y, registers[d]);
+            break;
+        case MIF:
+            if (x != 0)
+            {
+                registers[d] = y;
+            }
+            break;
+        case GTU:
+            registers[d] = x > y;
+            break;
+        case GTS:
+            registers[d] = static_cast<int16_t>(x) > static_cast<int16_t>(y);
+            break;
+        case LTU:
+            registers[d] = x < y;
+            break;
+        case LTS:
+            registers[d] = static_cast<int16_t>(x) < static_cast<int16_t>(y);
+            break;
+        case EQU:
+            registers[d] = x == y;
+            break;
+        case MAJ:
+            registers[d] = x;
+            registers[PC] = y;
+            break;
+        }
+    }
+
+    static uint16_t shift(uint16_t value, uint16_t control)
+    {
+        unsigned amount = control & 0x0F;
+        switch ((control >> 4) & 0x03)
+        {
+        case 0:
+            return static_cast<uint16_t>(static_cast<int16_t>(value) >> amount);
+        case 1:
+            return value >> amount;
+        case 2:
+            return static_cast<uint16_t>(value << amount);
+        default:
+            return static_cast<uint16_t>((value >> amount) | (value << ((16 - amount) & 0x0F)));
+        }
+    }
+
+private:
+    enum : uint8_t
+    {
+        HOOK = 1,       // code_flags: a native hook is installed
+        BREAKPOINT = 2, // code_flags
+        LISTED = 1,     // watch_flags: stores are listed in watched_stores
+        WRITE_WATCH = 2,
+        READ_WATCH = 4,
+        PORT = 8 // read() leaves it to read_flagged()
+    };
+
+    std::pmr::vector<uint8_t> code_flags;  // what step() does more than execute the instruction
+    std::pmr::vector<uint8_t> watch_flags; // what read() and write() do more than access memory
+    size_t watched = 0;               // addresses with LISTED or WRITE_WATCH
+    uint64_t limit = 0;               // cycle the run loop stops at, 0 once stop is set
+    std::unordered_map<uint16_t, NativeHook> hooks;
+    std::unordered_map<uint16_t, Device *> devices;
+    uint64_t sample_period = 0;
+    uint64_t next_sample = UINT64_MAX;
+    std::function<void(Machine &)> sampler;
+    uint64_t skip_limit = 0; // set by run() with skip_idle: polls may skip to before this cycle
+    bool polled = false;     // the last empty poll of this run, for skip_polling_loop():
+    uint64_t poll_cycles = 0;
+    uint16_t poll_registers[16] = {};
+    // Cells stored to since then with the value they had before (the first store to each
+    // counts); more than ROUND_WRITES for anything else that changes what the guest sees.
+    static constexpr size_t ROUND_WRITES = 64;
+    struct
+    {
+        uint16_t address;
+        uint16_t value;
+    } round_writes[ROUND_WRITES] = {};
+    size_t round_length = 0;
+
+    void log_round_write(uint16_t address)
+    {
+        if (round_length < ROUND_WRITES)
+        {
+            round_writes[round_length++] = {address, memory[address]};
+        }
+        else
+        {
+            round_length = ROUND_WRITES + 1;
+        }
+    }
+
+    // Every cell stored to since the last poll is back to what it was then.
+    bool round_restored() const
+    {
+        if (round_length > ROUND_WRITES)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < round_length; ++i)
+        {
+            bool first = true;
+            for (size_t j = 0; j < i && first; ++j)
+            {
+                first = round_writes[j].address != round_writes[i].address;
+            }
+            if (first && memory[round_writes[i].address] != round_writes[i].value)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void sample_if_due()
+    {
+        if (cycles >= next_sample)
+        {
+            next_sample += sample_period * ((cycles - next_sample) / sample_period + 1);
+            sampler(*this);
+        }
+    }
+
+    void set_watch_flag(uint16_t address, uint8_t flag, bool set)
+    {
+        bool before = watch_flags[address] & (LISTED | WRITE_WATCH);
+        watch_flags[address] = set ? watch_flags[address] | flag : watch_flags[address] & ~flag;
+        watched += (watch_flags[address] & (LISTED | WRITE_WATCH) ? 1 : 0) - (before ? 1 : 0);
+    }
+
+    void stop_at(StopReason reason, uint16_t address)
+    {
+        if (stop.reason == StopReason::NONE)
+        {
+            stop = {reason, address};
+        }
+        limit = 0;
+        skip_limit = 0;
+    }
+
+    // At a keyboard read that found nothing (see skip_idle). Rounds end strictly before
+    // skip_limit and before the next replayed key's cycle, so that read runs.
+    void skip_polling_loop()
+    {
+        if (!polled || !std::equal(registers, registers + 16, poll_registers) || !round_restored())
+        {
+            polled = true;
+            poll_cycles = cycles;
+            round_length = 0;
+            std::copy(registers, registers + 16, poll_registers);
+            return;
+        }
+        uint64_t period = cycles - poll_cycles;
+        uint64_t until = skip_limit;
+        if (input_replay && input_replayed < input_replay->size())
+        {
+            until = std::min(until, (*input_replay)[input_replayed].cycle);
+        }
+        uint64_t rounds = until > cycles && period > 0 ? (until - cycles - 1) / period : 0;
+        cycles += rounds * period;
+        empty_polls += rounds;
+        skipped_cycles += rounds * period;
+        poll_cycles = cycles;
+        round_length = 0;
+    }
+
+    void write_port(uint16_t address, uint16_t value)
+    {
+        auto it = devices.find(address);
+        if (it != devices.end())
+        {
+            it->second->write(address, value, cycles);
+        }
+    }
+
+    // The recorded key if it was read at this cycle, else nothing, as the recorded run found.
+    uint16_t replay_key()
+    {
+        if (input_replayed < input_replay->size() && (*input_replay)[input_replayed].cycle == cycles)
+        {
+            empty_polls = 0;
+            round_length = ROUND_WRITES + 1;
+            return (*input_replay)[input_replayed++].key;
+        }
+        empty_polls++;
+        if (skip_limit != 0)
+        {
+            skip_polling_loop();
+        }
+        return 0;
+    }
+
+    // A breakpoint stops before the instruction; otherwise the hook runs.
+    bool run_flagged(uint16_t address)
+    {
+        if (code_flags[address] & BREAKPOINT)
+        {
+            stop_at(StopReason::BREAKPOINT, address);
+            return true;
+        }
+        auto it = hooks.find(address);
+        return it != hooks.end() && it->second(*this);
+    }
+};
+
+// eForth waits for a key: the keyboard is empty and has been polled over and over with no
+// output in between (NUF? polls once per line while printing).
+inline bool waiting_for_input(const Machine &machine)
+{
+    return machine.keyboard.empty() && machine.empty_polls >= 100;
+}
+
+// Runs until waiting_for_input(). Checks every chunk cycles, so runs up to that much past it.
+inline bool run_until_idle(Machine &machine, uint64_t budget = 100000000, uint64_t chunk = 10000)
+{
+    uint64_t end = machine.cycles + budget;
+    while (!waiting_for_input(machine))
+    {
+        if (machine.cycles >= end)
+        {
+            return false;
+        }
+        machine.run(chunk);
+    }
+    return true;
+}
+
+// Reads a symbol table in table.txt format ("NAME hex" per line).
+inline std::unordered_map<std::string, uint16_t> parse_symbols(std::istream &text)
+{
+    std::unordered_map<std::string, uint16_t> symbols;
+    std::string name;
+    std::string value;
+    while (text >> name >> value)
+    {
+        symbols[name] = static_cast<uint16_t>(std::stoul(value, nullptr, 16));
+    }
+    return symbols;
+}
+
+inline std::unordered_map<std::string, uint16_t> load_symbols(const std::string &filename)
+{
+    std::ifstream file(filename);
+    return parse_symbols(file);
+}
@@ -0,0 +1,309 @@
+// The 640x480 framebuffer on a text terminal, for watching a machine without a window (over
+// SSH, say). Every character cell shows a block of pixels: a braille character 2 dots wide
+// and 4 high, or a half block 1 wide and 2 high, each dot scale x scale pixels and lit when
+// any of them is. Cells are built from the framebuffer 16 at a time (SSE2 or NEON, with a
+// scalar fallback), and TerminalView sends only the cells that changed since the last frame,
+// as cursor moves and UTF-8, in one string for one write.
+#pragma once
+
+#include "image.h"
+#include "sveu16.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum class CellMode : uint8_t
+{
+    BRAILLE,   // U+2800 + dot bits: 2x4 dots a cell, 160x60 cells at scale 2
+    HALF_BLOCK // space, upper, lower or full block: 1x2 dots a cell, 160x60 cells at scale 4
+};
+
+struct CellLayout
+{
+    CellMode mode = CellMode::BRAILLE;
+    int scale = 2; // pixels a dot is wide and high: 1, 2 or 4
+
+    int dots_across() const { return mode == CellMode::BRAILLE ? 2 : 1; }
+    int dots_down() const { return mode == CellMode::BRAILLE ? 4 : 2; }
+    int columns() const { return 640 / (dots_across() * scale); }
+    int rows() const { return 480 / (dots_down() * scale); }
+
+    // The cell bit for the dot across, down: braille numbers dots 1-3 down the left, 4-6 down
+    // the right, then 7 and 8 along the bottom.
+    uint8_t dot_bit(int across, int down) const
+    {
+        if (mode == CellMode::HALF_BLOCK)
+        {
+            return static_cast<uint8_t>(1 << down);
+        }
+        return static_cast<uint8_t>(down == 3 ? 0x40 << across : 1 << (down + 3 * across));
+    }
+};
+
+namespace viewer_detail
+{
+#if defined(__SSE2__) || defined(__ARM_NEON)
+#if defined(__SSE2__)
+using Vector = __m128i;
+
+inline Vector load(const uint8_t *bytes)
+{
+    return _mm_loadu_si128(reinterpret_cast<const Vector *>(bytes));
+}
+
+inline Vector splat(uint8_t byte)
+{
+    return _mm_set1_epi8(static_cast<char>(byte));
+}
+
+inline void store_or(uint8_t *bytes, Vector v)
+{
+    _mm_storeu_si128(reinterpret_cast<Vector *>(bytes), _mm_or_si128(load(bytes), v));
+}
+
+// bits in the bytes where pixels & mask is not 0
+inline Vector lit(Vector pixels, Vector mask, Vector bits)
+{
+    return _mm_andnot_si128(_mm_cmpeq_epi8(_mm_and_si128(pixels, mask), _mm_setzero_si128()), bits);
+}
+
+// bytes 0-7 or 8-15 of v, each twice
+inline Vector low_half(Vector v)
+{
+    return _mm_unpacklo_epi8(v, v);
+}
+
+inline Vector high_half(Vector v)
+{
+    return _mm_unpackhi_epi8(v, v);
+}
+#else
+using Vector = uint8x16_t;
+
+inline Vector load(const uint8_t *bytes)
+{
+    return vld1q_u8(bytes);
+}
+
+inline Vector splat(uint8_t byte)
+{
+    return vdupq_n_u8(byte);
+}
+
+inline void store_or(uint8_t *bytes, Vector v)
+{
+    vst1q_u8(bytes, vorrq_u8(vld1q_u8(bytes), v));
+}
+
+inline Vector lit(Vector pixels, Vector mask, Vector bits)
+{
+    return vandq_u8(vtstq_u8(pixels, mask), bits);
+}
+
+inline Vector low_half(Vector v)
+{
+    return vzipq_u8(v, v).val[0];
+}
+
+inline Vector high_half(Vector v)
+{
+    return vzipq_u8(v, v).val[1];
+}
+#endif
+
+// Every byte of v COPIES times over, in order, in parts[0] to parts[COPIES - 1].
+template <int COPIES> void spread(Vector v, Vector *parts)
+{
+    if constexpr (COPIES == 1)
+    {
+        parts[0] = v;
+    }
+    else
+    {
+        spread<COPIES / 2>(low_half(v), parts);
+        spread<COPIES / 2>(high_half(v), parts + COPIES / 2);
+    }
+}
+#endif
+
+// ORs bit into each of the 16 * COPIES cells made from 16 pixel bytes, cell i taking byte
+// i / COPIES, where byte & masks[i % 16] has any pixel lit (masks repeat every COPIES).
+template <int COPIES> void light_cells(const uint8_t *bytes, const uint8_t *masks, uint8_t bit, uint8_t *cells)
+{
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    Vector parts[COPIES];
+    spread<COPIES>(load(bytes), parts);
+    Vector mask = load(masks);
+    Vector bits = splat(bit);
+    for (int i = 0; i < COPIES; ++i)
+    {
+        store_or(cells + 16 * i, lit(parts[i], mask, bits));
+    }
+#else
+    for (int i = 0; i < 16 * COPIES; ++i)
+    {
+        cells[i] |= (bytes[i / COPIES] & masks[i % 16]) != 0 ? bit : 0;
+    }
+#endif
+}
+
+// The cells a row of dots lights, 80 pixel bytes at a time.
+template <int COPIES> void light_row(const uint8_t *bytes, const uint8_t *masks, uint8_t bit, uint8_t *cells)
+{
+    for (int i = 0; i < 80; i += 16)
+    {
+        light_cells<COPIES>(bytes + i, masks, bit, cells + i * COPIES);
+    }
+}
+} // namespace viewer_detail
+
+// The cells of the frame at video (VIDEO_MEMORY_WORDS words), layout.columns() a row.
+inline void frame_cells(const uint16_t *video, const CellLayout &layout, std::vector<uint8_t> &cells)
+{
+    const int columns = layout.columns();
+    const int cell_pixels = layout.dots_across() * layout.scale;
+    const int copies = 8 / cell_pixels; // cells a pixel byte spans
+    cells.assign(static_cast<size_t>(columns) * layout.rows(), 0);
+
+    // masks[across][i]: the pixels of dot column across in the cell i % copies of a byte,
+    // the leftmost pixel being the top bit
+    uint8_t masks[2][16] = {};
+    for (int across = 0; across < layout.dots_across(); ++across)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            int first = i % copies * cell_pixels + across * layout.scale;
+            masks[across][i] = static_cast<uint8_t>((0xFF00 >> layout.scale & 0xFF) >> first);
+        }
+    }
+
+    uint16_t lit[40];
+    uint8_t bytes[80];
+    for (int row = 0; row < layout.rows(); ++row)
+    {
+        uint8_t *cell_row = cells.data() + static_cast<size_t>(row) * columns;
+        for (int down = 0; down < layout.dots_down(); ++down)
+        {
+            const uint16_t *line = video + (row * layout.dots_down() + down) * layout.scale * 40;
+            std::memcpy(lit, line, sizeof(lit));
+            for (int extra = 1; extra < layout.scale; ++extra)
+            {
+                for (int i = 0; i < 40; ++i)
+                {
+                    lit[i] |= line[40 * extra + i];
+                }
+            }
+            // a word's high byte holds its left 8 pixels
+            encode_words(lit, 40, ByteOrder::BIG, bytes);
+            for (int across = 0; across < layout.dots_across(); ++across)
+            {
+                uint8_t bit = layout.dot_bit(across, down);
+                switch (copies)
+                {
+                case 1: viewer_detail::light_row<1>(bytes, masks[across], bit, cell_row); break;
+                case 2: viewer_detail::light_row<2>(bytes, masks[across], bit, cell_row); break;
+                case 4: viewer_detail::light_row<4>(bytes, masks[across], bit, cell_row); break;
+                default: viewer_detail::light_row<8>(bytes, masks[across], bit, cell_row); break;
+                }
+            }
+        }
+    }
+}
+
+// Draws frames on an ANSI terminal, each as the changes from the one before.
+class TerminalView
+{
+public:
+    explicit TerminalView(CellLayout layout = CellLayout()) : layout(layout) {}
+
+    CellLayout layout;
+
+    // The text that turns the terminal's picture into the frame at video: the first time (or
+    // after redraw()) it clears the screen, hides the cursor and draws the cells that are not
+    // blank; after that only the runs of cells that changed, each after a cursor move. Runs
+    // closer than a cursor move's length are joined.
+    std::string frame(const uint16_t *video)
+    {
+        frame_cells(video, layout, cells);
+        std::string text;
+        if (shown.empty())
+        {
+            text = "\x1b[?25l\x1b[H\x1b[2J";
+            shown.assign(cells.size(), 0); // all blank once cleared
+        }
+        const size_t columns = layout.columns();
+        for (size_t row = 0; row < static_cast<size_t>(layout.rows()); ++row)
+        {
+            const uint8_t *now = cells.data() + row * columns;
+            uint8_t *before = shown.data() + row * columns;
+            size_t column = 0;
+            while (column < columns)
+            {
+                if (now[column] == before[column])
+                {
+                    column++;
+                    continue;
+                }
+                size_t end = column + 1;
+                for (size_t same = 0; end < columns && same < 8; ++end)
+                {
+                    same = now[end] == before[end] ? same + 1 : 0;
+                }
+                while (now[end - 1] == before[end - 1])
+                {
+                    end--;
+                }
+                text += "\x1b[" + std::to_string(row + 1) + ";" + std::to_string(column + 1) + "H";
+                for (; column < end; ++column)
+                {
+                    append_glyph(text, now[column]);
+                    before[column] = now[column];
+                }
+            }
+        }
+        return text;
+    }
+
+    // Has the next frame drawn whole, as when the terminal may have lost the picture.
+    void redraw()
+    {
+        shown.clear();
+    }
+
+    // Shows the cursor again, below the picture.
+    std::string restore() const
+    {
+        return "\x1b[" + std::to_string(layout.rows() + 1) + ";1H\x1b[?25h";
+    }
+
+private:
+    std::vector<uint8_t> cells;
+    std::vector<uint8_t> shown; // the cells on the terminal, empty before the first frame
+
+    void append_glyph(std::string &text, uint8_t cell) const
+    {
+        if (cell == 0)
+        {
+            text += ' ';
+        }
+        else if (layout.mode == CellMode::BRAILLE)
+        {
+            text += static_cast<char>(0xE2);
+            text += static_cast<char>(0xA0 | cell >> 6);
+            text += static_cast<char>(0x80 | (cell & 0x3F));
+        }
+        else
+        {
+            static const char *const BLOCKS[] = {" ", "▀", "▄", "█"};
+            text += BLOCKS[cell & 3];
+        }
+    }
+};
@@ -0,0 +1,203 @@
+// Exact cycle accounting per Forth word, kept by watching the inner interpreter. Every word
+// it dispatches (at NEXT1, or inline at the end of LIST1 for the first word of a colon body)
+// opens a frame on a shadow call stack that is charged from that cycle on, dispatch included.
+//   code word:  the frame ends at the next NEXT1
+//   colon word: LIST1 marks the frame with the return stack cell it pushes the caller's IP
+//               to, and the frame ends at the first NEXT1 that finds R3 above that cell;
+//               that is its EXIT (EXIT1 falls through into NEXT1), or a THROW, or the R>
+//               of _VAR and _CON taking the return for themselves
+// A word run from EXECUTE is a frame inside EXECUTE's. Inclusive cycles count once for a word
+// that is on the stack more than once; exclusive cycles are a frame's own less its children's,
+// so that of a colon word is its dispatch and the three cycles LIST1 takes to push the IP.
+// Frames follow R3, so they are those of whichever task runs (the operator's, unless tasks
+// are built). sveu16 only compiles this in with -DSVEU16_WORD_CYCLES.
+#pragma once
+
+#include "dictionary.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class WordCycles
+{
+public:
+    struct Totals
+    {
+        uint64_t calls = 0;
+        uint64_t inclusive = 0;
+        uint64_t exclusive = 0;
+        uint32_t active = 0; // frames of the word on the stack
+    };
+
+    // Hooks NEXT1 and LIST1, found from the code field most headers have, in front of any hook
+    // already there (LIST1 has one for native colon words). Returns false when the image has
+    // no colon words.
+    bool attach(Machine &machine)
+    {
+        list1 = colon_code(machine.memory, find_headers(machine.memory, VIDEO_MEMORY_START));
+        if (list1 < NEXT_LENGTH)
+        {
+            return false;
+        }
+        next1 = list1 - NEXT_LENGTH;
+        NativeHook next = machine.hook(next1);
+        machine.install_hook(next1, [this, next](Machine &m) {
+            dispatch(m);
+            return next && next(m);
+        });
+        NativeHook list = machine.hook(list1);
+        machine.install_hook(list1, [this, list](Machine &m) {
+            if (list && list(m))
+            {
+                return true; // the whole word ran natively and ends at NEXT1 like a code word
+            }
+            enter(m);
+            return false;
+        });
+        return true;
+    }
+
+    // Ends every open frame at the machine's current cycle.
+    void finish(const Machine &machine)
+    {
+        while (!frames.empty())
+        {
+            pop(machine.cycles);
+        }
+    }
+
+    const Totals &totals(uint16_t cfa) const
+    {
+        return words[cfa];
+    }
+
+    // One line per word that was called, by exclusive cycles: word,cfa,calls,inclusive,exclusive.
+    // Names are from the dictionary as it is now, then from table.txt, else the address.
+    std::string csv(const Machine &machine, const std::unordered_map<std::string, uint16_t> &symbols) const
+    {
+        std::unordered_map<uint16_t, std::string> names;
+        for (const auto &symbol : symbols)
+        {
+            auto name = names.emplace(symbol.second, symbol.first);
+            if (!name.second && symbol.first < name.first->second)
+            {
+                name.first->second = symbol.first;
+            }
+        }
+        for (const auto &header : find_headers(machine.memory, VIDEO_MEMORY_START))
+        {
+            names[name_to_cfa(machine.memory, header.second)] = header_name(machine.memory, header.second);
+        }
+
+        std::vector<uint16_t> called;
+        for (uint32_t cfa = 0; cfa < words.size(); ++cfa)
+        {
+            if (words[cfa].calls > 0)
+            {
+                called.push_back(static_cast<uint16_t>(cfa));
+            }
+        }
+        std::sort(called.begin(), called.end(), [this](uint16_t a, uint16_t b) {
+            return words[a].exclusive != words[b].exclusive ? words[a].exclusive > words[b].exclusive : a < b;
+        });
+
+        std::string text = "word,cfa,calls,inclusive,exclusive\n";
+        char line[96];
+        for (uint16_t cfa : called)
+        {
+            auto it = names.find(cfa);
+            std::snprintf(line, sizeof(line), "$%04X", cfa);
+            std::string name = it != names.end() ? it->second : line;
+            for (size_t at = name.find('"'); at != std::string::npos; at = name.find('"', at + 2))
+            {
+                name.insert(at, 1, '"');
+            }
+            const Totals &word = words[cfa];
+            std::snprintf(line, sizeof(line), ",%04X,%llu,%llu,%llu\n", cfa, static_cast<unsigned long long>(word.calls),
+                          static_cast<unsigned long long>(word.inclusive),
+                          static_cast<unsigned long long>(word.exclusive));
+            text += "\"" + name + "\"" + line;
+        }
+        return text;
+    }
+
+private:
+    static constexpr uint16_t NEXT_LENGTH = 3; // NEXT1 is the three instructions before LIST1
+    static constexpr uint16_t LIST_PUSH = 3;   // LIST1 pushes the IP, then dispatches inline
+    static constexpr size_t MAX_FRAMES = 4096;
+
+    struct Frame
+    {
+        uint16_t cfa;
+        bool colon;
+        uint16_t rp; // colon words: where LIST1 pushed the caller's IP
+        uint64_t start;
+        uint64_t children;
+    };
+
+    uint16_t list1 = 0;
+    uint16_t next1 = 0;
+    std::vector<Frame> frames;
+    std::vector<Totals> words = std::vector<Totals>(65536);
+
+    // NEXT1: the code word that jumped here has ended, and so has every colon word whose
+    // pushed IP R3 is now above. The word at IP is dispatched.
+    void dispatch(const Machine &machine)
+    {
+        uint16_t rp = machine.registers[3];
+        while (!frames.empty() && (!frames.back().colon || frames.back().rp < rp))
+        {
+            pop(machine.cycles);
+        }
+        push(machine.memory[machine.registers[4]], machine.cycles);
+    }
+
+    // LIST1: the word being dispatched (R5) is a colon word. One reached without a dispatch,
+    // from EXECUTE, gets its frame here.
+    void enter(const Machine &machine)
+    {
+        uint16_t cfa = machine.registers[5];
+        if (frames.empty() || frames.back().cfa != cfa || frames.back().colon)
+        {
+            push(cfa, machine.cycles);
+        }
+        frames.back().colon = true;
+        frames.back().rp = machine.registers[3] - 1;
+        push(machine.memory[static_cast<uint16_t>(cfa + 1)], machine.cycles + LIST_PUSH);
+    }
+
+    void push(uint16_t cfa, uint64_t start)
+    {
+        if (frames.size() == MAX_FRAMES)
+        {
+            while (!frames.empty())
+            {
+                pop(start); // a return stack that never unwinds; start again from here
+            }
+        }
+        frames.push_back({cfa, false, 0, start, 0});
+        Totals &word = words[cfa];
+        ++word.calls;
+        ++word.active;
+    }
+
+    void pop(uint64_t now)
+    {
+        Frame frame = frames.back();
+        frames.pop_back();
+        uint64_t spent = now > frame.start ? now - frame.start : 0;
+        Totals &word = words[frame.cfa];
+        word.exclusive += spent - std::min(spent, frame.children);
+        if (--word.active == 0)
+        {
+            word.inclusive += spent;
+        }
+        if (!frames.empty())
+        {
+            frames.back().children += spent;
+        }
+    }
+};